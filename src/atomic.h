@@ -48,14 +48,49 @@
 
 // adds value to target and returns previous value of target
 #define INCR(target_p, val) \
-    atomic_fetch_add_explicit(target_p, src, memory_order_acq_rel)
+    atomic_fetch_add_explicit(target_p, val, memory_order_acq_rel)
 
 // subtracts value from target and returns previous value of target
 #define DECR(target_p, val) \
-    atomic_fetch_sub_explicit(target_p, src, memory_order_acq_rel)
+    atomic_fetch_sub_explicit(target_p, val, memory_order_acq_rel)
+
+// ors value into target and returns previous value of target
+#define OR(target_p, val) \
+    atomic_fetch_or_explicit(target_p, val, memory_order_acq_rel)
+
+// ands value into target and returns previous value of target
+#define AND(target_p, val) \
+    atomic_fetch_and_explicit(target_p, val, memory_order_acq_rel)
 
 // sets memory fence between signal handler and normal code
 #define SIGFENCE \
     atomic_signal_fence(memory_order_seq_cst)
 
+// sets full memory fence between threads (orders a store before a load)
+#define FENCE \
+    atomic_thread_fence(memory_order_seq_cst)
+
+// tells the processor we are spinning
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_RELAX __builtin_ia32_pause()
+#else
+#define CPU_RELAX
+#endif
+
+// spin lock (zero-initialized lock is free)
+typedef atomic_flag Spinlock;
+
+// acquires spin lock
+#define SPIN_LOCK(lock_p) \
+    while (atomic_flag_test_and_set_explicit(lock_p, memory_order_acquire)) \
+        CPU_RELAX
+
+// releases spin lock
+#define SPIN_UNLOCK(lock_p) \
+    atomic_flag_clear_explicit(lock_p, memory_order_release)
+
+// initializes spin lock (free), e.g. one in memory not zeroed
+#define SPIN_INIT(lock_p) \
+    atomic_flag_clear_explicit(lock_p, memory_order_relaxed)
+
 #endif
@@ -0,0 +1,150 @@
+
+/**
+ *  Streams numbered samples from a sensor to an ingest process,
+ *  either one sample per rendezvous on an ordinary channel or in
+ *  batches on a batch channel, and reports the time per sample.  The
+ *  sensor offers up to wn samples at a time and the ingest process
+ *  takes up to rn of them; the sensor offers again whatever was left.
+ *  Usage: batch [wn [rn]]    (each from 1 to MAX_BATCH; wn 0 for an
+ *                             ordinary channel)
+ *  e.g.   ./examples/batch 0; ./examples/batch 64; ./examples/batch 64 48
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_BATCH  1024        // most samples per batch
+#define NSAMPLES   4000000     // # of samples streamed
+
+typedef struct Sample {
+    int seq;          // sample number
+    int value;        // reading
+} Sample;
+
+static unsigned int wn, rn;    // samples per batch offered, taken
+
+Channel channel;               // sensor to ingest (one at a time)
+BatchChannel batch;            // sensor to ingest (in batches)
+
+Sample sensor_samples[MAX_BATCH];   // samples sensor offers
+Sample ingest_samples[MAX_BATCH];   // samples ingest process took
+
+PROCESS(Sensor)
+    Guard guards[1];
+    unsigned int first;        // first sample not yet taken
+    unsigned int count;        // # of samples not yet taken
+    int seq;                   // next sample number
+ENDPROC
+
+/** Fills sensor's array with the next samples */
+static void read_samples(Sensor *sensor)
+{
+    unsigned int i;
+    for (i = 0; i < wn; i++) {
+        sensor_samples[i].seq = sensor->seq;
+        sensor_samples[i].value = sensor->seq * 3;
+        sensor->seq++;
+    }
+    sensor->first = 0;
+    sensor->count = wn;
+}
+
+void Sensor_rtc(void *local)
+{
+    Sensor *sensor = (Sensor *)local;
+    if (initial()) {
+        init_alt(sensor->guards, 1);
+        sensor->seq = 0;
+        if (wn == 0) {
+            init_chanout_guard(&sensor->guards[0], out(&channel),
+                &sensor_samples[0]);
+        } else {
+            read_samples(sensor);
+        }
+        activate(&sensor->guards[0]);
+    } else if (wn == 0) {
+        sensor_samples[0].seq = ++sensor->seq;
+        sensor_samples[0].value = sensor->seq * 3;
+    } else {
+        unsigned int taken = batch_count(&batch);
+        sensor->first += taken;
+        sensor->count -= taken;
+        if (sensor->count == 0) {
+            read_samples(sensor);
+        }
+    }
+    // offer the samples not yet taken
+    if (wn > 0) {
+        init_batchout_guard(&sensor->guards[0], &batch,
+            &sensor_samples[sensor->first], sensor->count);
+    }
+}
+
+PROCESS(Ingest)
+    Guard guards[1];
+    int seq;                   // next sample number expected
+    Time t0;
+ENDPROC
+void Ingest_rtc(void *local)
+{
+    Ingest *ingest = (Ingest *)local;
+    if (initial()) {
+        init_alt(ingest->guards, 1);
+        if (wn == 0) {
+            init_chanin_guard(&ingest->guards[0], in(&channel),
+                &ingest_samples[0], sizeof(Sample));
+        } else {
+            init_batchin_guard(&ingest->guards[0], &batch,
+                ingest_samples, rn);
+        }
+        activate(&ingest->guards[0]);
+        ingest->seq = 0;
+        ingest->t0 = Now();
+    } else {
+        // check samples are the next in sequence
+        unsigned int n = (wn == 0 ? 1 : batch_count(&batch));
+        unsigned int i;
+        for (i = 0; i < n; i++) {
+            Sample *s = &ingest_samples[i];
+            if (s->seq != ingest->seq || s->value != s->seq * 3) {
+                printf("Got %d, expected %d\n", s->seq, ingest->seq);
+                exit(1);
+            }
+            ingest->seq++;
+        }
+        if (ingest->seq >= NSAMPLES) {
+            Time t1 = Now();
+            printf("Time per sample = %g nsec\n",
+                (double)(t1 - ingest->t0) / ingest->seq);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    wn = (argc > 1 ? atoi(argv[1]) : 64);
+    rn = (argc > 2 ? atoi(argv[2]) : wn);
+    if (wn > MAX_BATCH || (wn > 0 && (rn < 1 || rn > MAX_BATCH))) {
+        printf("Batch sizes must be from 1 to %d\n", MAX_BATCH);
+        exit(1);
+    }
+    if (wn == 0) {
+        printf("One sample per rendezvous\n");
+    } else {
+        printf("Batches of %u samples offered, up to %u taken\n", wn, rn);
+    }
+
+    initialize(8192);
+
+    init_channel(&channel);
+    init_batch_channel(&batch, sizeof(Sample));
+
+    Sensor sensor;
+    START(Sensor, &sensor, 1);
+    Ingest ingest;
+    START(Ingest, &ingest, 1);
+
+    run();
+}
@@ -0,0 +1,137 @@
+
+/**
+ *  Producer/consumer through a buffered channel.  The consumer ALTs
+ *  over the buffered channel and an ordinary channel from a second,
+ *  slower producer, checks that both streams arrive in order, and
+ *  reports the time per message.
+ *  Usage: buffered [capacity]
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NMSGS     10000000   // # of messages through buffered channel
+#define MAX_CAPACITY  4096   // most items buffered channel can hold
+#define SLOW_EVERY    1000   // slow producer sends once per this many
+
+BufferedChannel fast;        // fast producer to consumer
+Channel slow;                // slow producer to consumer
+
+int buffer[MAX_CAPACITY];    // buffered channel's items
+
+PROCESS(FastProducer)
+    Guard guards[1];
+    int x;
+ENDPROC
+void FastProducer_rtc(void *local)
+{
+    FastProducer *producer = (FastProducer *)local;
+    if (initial()) {
+        init_alt(producer->guards, 1);
+        init_bufout_guard(&producer->guards[0], &fast, &producer->x);
+        activate(&producer->guards[0]);
+        producer->x = 1;
+    } else {
+        // just sent item, send next one
+        if (++producer->x > NMSGS) {
+            terminate();
+        }
+    }
+}
+
+PROCESS(SlowProducer)
+    Guard guards[1];
+    int x;
+ENDPROC
+void SlowProducer_rtc(void *local)
+{
+    SlowProducer *producer = (SlowProducer *)local;
+    if (initial()) {
+        init_alt(producer->guards, 1);
+        init_chanout_guard(&producer->guards[0], out(&slow), &producer->x);
+        activate(&producer->guards[0]);
+        producer->x = 1;
+    } else {
+        producer->x++;
+    }
+}
+
+PROCESS(Consumer)
+    Guard guards[2];
+    int x;
+    int next_fast;    // next value expected from fast producer
+    int next_slow;    // next value expected from slow producer
+    Time t0;
+ENDPROC
+void Consumer_rtc(void *local)
+{
+    // branch 0 for buffered channel, branch 1 for ordinary channel
+    enum { FAST=0, SLOW };
+
+    Consumer *consumer = (Consumer *)local;
+    if (initial()) {
+        init_alt(consumer->guards, 2);
+        init_bufin_guard(&consumer->guards[FAST], &fast, &consumer->x);
+        init_chanin_guard(&consumer->guards[SLOW], in(&slow),
+            &consumer->x, sizeof(consumer->x));
+        activate(&consumer->guards[FAST]);
+        deactivate(&consumer->guards[SLOW]);
+        consumer->next_fast = consumer->next_slow = 1;
+        consumer->t0 = Now();
+
+    } else {
+        switch (selected()) {
+        case FAST:
+            if (consumer->x != consumer->next_fast) {
+                printf("Fast: got %d, expected %d\n",
+                    consumer->x, consumer->next_fast);
+                exit(1);
+            }
+            if (consumer->next_fast++ == NMSGS) {
+                Time t1 = Now();
+                printf("Time per message = %g nsec\n",
+                    (double)(t1 - consumer->t0) / NMSGS);
+                exit(0);
+            }
+            // now and then, let the slow producer in
+            set_active(&consumer->guards[SLOW],
+                consumer->next_fast % SLOW_EVERY == 0);
+            break;
+
+        case SLOW:
+            if (consumer->x != consumer->next_slow) {
+                printf("Slow: got %d, expected %d\n",
+                    consumer->x, consumer->next_slow);
+                exit(1);
+            }
+            consumer->next_slow++;
+            deactivate(&consumer->guards[SLOW]);
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int capacity = (argc > 1 ? atoi(argv[1]) : 64);
+    if (capacity < 1 || capacity > MAX_CAPACITY) {
+        printf("Capacity must be from 1 to %d\n", MAX_CAPACITY);
+        exit(1);
+    }
+    printf("Capacity %d\n", capacity);
+
+    initialize(32768);
+
+    init_buffered_channel(&fast, buffer, sizeof(int), capacity);
+    init_channel(&slow);
+
+    FastProducer fast_producer;
+    START(FastProducer, &fast_producer, 1);
+    SlowProducer slow_producer;
+    START(SlowProducer, &slow_producer, 1);
+    Consumer consumer;
+    START(Consumer, &consumer, 1);
+
+    run();
+}
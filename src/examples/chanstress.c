@@ -0,0 +1,168 @@
+/**
+ *  Stress test for channels between cores.  Producers send numbered
+ *  messages through relays to one consumer, which ALTs over all the
+ *  relays and checks that every stream arrives complete and in order.
+ *  Build with -DSMP=1; usage: chanstress [ncores [mode]]
+ *  (the consumer's ALT is ordinary if mode is 0, event-driven if 1,
+ *  and persistent if 2)
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NSTREAMS  8         // # of producer-relay streams
+#define NMSGS     200000    // # of messages per stream
+
+Channel first[NSTREAMS];    // producer to relay
+Channel second[NSTREAMS];   // relay to consumer
+Guard consumer_guards[NSTREAMS];  // consumer's guards (kept out of its
+                                  // locals, to fit a memory block)
+
+int expected[NSTREAMS];     // next sequence number expected per stream
+
+static int mode;            // kind of ALT consumer uses (see above)
+
+PROCESS(Producer)
+    Guard guards[1];
+    ChanOut *output;
+    int seq;
+ENDPROC
+void Producer_rtc(void *local)
+{
+    Producer *producer = (Producer *)local;
+    if (initial()) {
+        init_alt(producer->guards, 1);
+        init_chanout_guard(&producer->guards[0], 
+            producer->output, &producer->seq);
+        activate(&producer->guards[0]);
+        producer->seq = 1;
+    } else {
+        // just sent message, send next one
+        if (++producer->seq > NMSGS) {
+            terminate();
+        }
+    }
+}
+
+PROCESS(Relay)
+    Guard guards[2];
+    ChanIn *input;
+    ChanOut *output;
+    int seq;
+ENDPROC
+void Relay_rtc(void *local)
+{
+    // branch 0 for input, branch 1 for output
+    enum { IN=0, OUT };
+
+    Relay *relay = (Relay *)local;
+    if (initial()) {
+        init_alt(relay->guards, 2);
+        init_chanin_guard(&relay->guards[IN], relay->input,
+            &relay->seq, sizeof(relay->seq));
+        init_chanout_guard(&relay->guards[OUT], relay->output, &relay->seq);
+        activate(&relay->guards[IN]);
+        deactivate(&relay->guards[OUT]);
+    } else {
+        switch (selected()) {
+        case IN:
+            deactivate(&relay->guards[IN]);
+            activate(&relay->guards[OUT]);
+            break;
+        case OUT:
+            if (relay->seq == NMSGS) {
+                terminate();
+            }
+            activate(&relay->guards[IN]);
+            deactivate(&relay->guards[OUT]);
+            break;
+        }
+    }
+}
+
+PROCESS(Consumer)
+    AltState alt;              // (event-driven and persistent modes)
+    int seq;
+    int done;                  // # of streams complete
+    Time t0;
+ENDPROC
+void Consumer_rtc(void *local)
+{
+    Consumer *consumer = (Consumer *)local;
+    if (initial()) {
+        if (mode == 2) {
+            init_alt_persistent(consumer_guards, NSTREAMS, &consumer->alt);
+        } else if (mode == 1) {
+            init_alt_event(consumer_guards, NSTREAMS, &consumer->alt);
+        } else {
+            init_alt(consumer_guards, NSTREAMS);
+        }
+        int i;
+        for (i = 0; i < NSTREAMS; i++) {
+            init_chanin_guard(&consumer_guards[i], in(&second[i]),
+                &consumer->seq, sizeof(consumer->seq));
+            activate(&consumer_guards[i]);
+            expected[i] = 1;
+        }
+        consumer->done = 0;
+        consumer->t0 = Now();
+    } else {
+        // check message is next in its stream
+        int i = selected();
+        if (consumer->seq != expected[i]) {
+            printf("Stream %d: got %d, expected %d\n", 
+                i, consumer->seq, expected[i]);
+            exit(1);
+        }
+        if (++expected[i] > NMSGS) {
+            deactivate(&consumer_guards[i]);
+            if (++consumer->done == NSTREAMS) {
+                Time t1 = Now();
+                printf("OK: %d messages in %g sec\n", NSTREAMS * NMSGS,
+                    (double)(t1 - consumer->t0) / 1e9);
+                exit(0);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ncores = (argc > 1 ? atoi(argv[1]) : 1);
+    mode = (argc > 2 ? atoi(argv[2]) : 0);
+    static char *modes[] = { "", ", event-driven ALT", ", persistent ALT" };
+    if (mode < 0 || mode > 2) {
+        printf("Mode must be 0, 1 or 2\n");
+        exit(1);
+    }
+    printf("%d streams on %d cores%s\n", NSTREAMS, ncores, modes[mode]);
+
+    // room for the processes (and each core's idle process)
+    initialize(PROCESS_MEMORY(Consumer) +
+        NSTREAMS*(PROCESS_MEMORY(Producer) + PROCESS_MEMORY(Relay)) +
+        ncores*process_memory(0));
+    set_cores(ncores);
+
+    int i;
+    for (i = 0; i < NSTREAMS; i++) {
+        init_channel(&first[i]);
+        init_channel(&second[i]);
+    }
+
+    // put consumer on core 0 and spread producers and relays
+    // so that each of their channels crosses cores
+    Consumer consumer;
+    START_ON(Consumer, &consumer, 1, 0);
+    Producer producer[NSTREAMS];
+    Relay relay[NSTREAMS];
+    for (i = 0; i < NSTREAMS; i++) {
+        producer[i].output = out(&first[i]);
+        START_ON(Producer, &producer[i], 1, (i + 1) % ncores);
+        relay[i].input = in(&first[i]);
+        relay[i].output = out(&second[i]);
+        START_ON(Relay, &relay[i], 1, (i + 2) % ncores);
+    }
+
+    run();
+}
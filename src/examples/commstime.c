@@ -1,11 +1,45 @@
 
 /*
  * The commstime demo.
+ * Usage: commstime [handoff [small [broadcast]]]    (each 0 or 1)
+ * With broadcast, Prefix outputs to Succ and Consume at once on a
+ * broadcast channel, and there is no Delta process.
  */
 #include "microcsp.h"
 #include <stdio.h>
+#include <stdlib.h>
 #define REPORT_INTERVAL 1000000
 
+// true to use small channels
+static _Bool small;
+
+// true to broadcast instead of using Delta
+static _Bool broadcast;
+
+// broadcast channel from Prefix to Succ (reader 0) and Consume (reader 1)
+BroadcastChannel bc;
+enum { SUCC_READER=0, CONSUME_READER };
+
+/** Initializes input guard for int */
+static void init_input_guard(Guard *guard, ChanIn *chan, int *x)
+{
+    if (small) {
+        init_small_chanin_guard(guard, chan, x, sizeof(int));
+    } else {
+        init_chanin_guard(guard, chan, x, sizeof(int));
+    }
+}
+
+/** Initializes output guard for int */
+static void init_output_guard(Guard *guard, ChanOut *chan, int *x)
+{
+    if (small) {
+        init_small_chanout_guard(guard, chan, x, sizeof(int));
+    } else {
+        init_chanout_guard(guard, chan, x);
+    }
+}
+
 /** Prefix process */
 PROCESS(Prefix)
     int x;
@@ -19,8 +53,12 @@ void Prefix_rtc(void *local)
     Prefix *prefix = (Prefix *)local;
     if (initial()) {
         init_alt(prefix->guards, 2);
-        init_chanin_guard(&prefix->guards[IN], prefix->in, &prefix->x, sizeof(int));
-        init_chanout_guard(&prefix->guards[OUT], prefix->out, &prefix->x);
+        init_input_guard(&prefix->guards[IN], prefix->in, &prefix->x);
+        if (broadcast) {
+            init_bcastout_guard(&prefix->guards[OUT], &bc, &prefix->x);
+        } else {
+            init_output_guard(&prefix->guards[OUT], prefix->out, &prefix->x);
+        }
         activate(&prefix->guards[IN]);     // will initially output
         deactivate(&prefix->guards[OUT]);
     } 
@@ -46,9 +84,9 @@ void Delta_rtc(void *local)
     Guard *out2Guard = &delta->guards[OUT2];
     if (initial()) {
         init_alt(delta->guards, 3);
-        init_chanin_guard(inGuard, delta->in, &delta->x, sizeof(int));
-        init_chanout_guard(out1Guard, delta->out1, &delta->x);
-        init_chanout_guard(out2Guard, delta->out2, &delta->x);
+        init_input_guard(inGuard, delta->in, &delta->x);
+        init_output_guard(out1Guard, delta->out1, &delta->x);
+        init_output_guard(out2Guard, delta->out2, &delta->x);
         activate(inGuard);      // will initially input
         deactivate(out1Guard);
         deactivate(out2Guard);
@@ -87,8 +125,13 @@ void Succ_rtc(void *local)
     Guard *outGuard = &succ->guards[OUT];
     if (initial()) {
         init_alt(succ->guards, 2);
-        init_chanin_guard(inGuard, succ->in, &succ->x, sizeof(int));
-        init_chanout_guard(outGuard, succ->out, &succ->x);
+        if (broadcast) {
+            init_bcastin_guard(inGuard, &bc, SUCC_READER, 
+                &succ->x, sizeof(int));
+        } else {
+            init_input_guard(inGuard, succ->in, &succ->x);
+        }
+        init_output_guard(outGuard, succ->out, &succ->x);
         deactivate(inGuard);     // will initially input
         activate(outGuard);
     }
@@ -109,7 +152,12 @@ void Consume_rtc(void *local)
     Consume *consume = (Consume *)local;
     if (initial()) {
         init_alt(consume->guards, 1);
-        init_chanin_guard(consume->guards, consume->in, &consume->x, sizeof(int));
+        if (broadcast) {
+            init_bcastin_guard(consume->guards, &bc, CONSUME_READER,
+                &consume->x, sizeof(int));
+        } else {
+            init_input_guard(consume->guards, consume->in, &consume->x);
+        }
         activate(consume->guards);
         consume->t0 = Now();       // starting time
     } else {
@@ -126,17 +174,32 @@ void Consume_rtc(void *local)
 
 // channels
 Channel a, b, c, d;
+SmallChannel sa, sb, sc, sd;    // (used instead if small)
 
 int main(int argc, char ** argv)
 {
     // initialize system
     initialize(1024);
 
+    // use direct handoff if asked ("commstime 1")
+    set_handoff(argc > 1 && atoi(argv[1]));
+
+    // use small channels if asked ("commstime 0 1")
+    small = (argc > 2 && atoi(argv[2]));
+
+    // broadcast if asked ("commstime 0 0 1")
+    broadcast = (argc > 3 && atoi(argv[3]));
+
     // initialize the channels
     init_channel(&a);
     init_channel(&b);
     init_channel(&c);
     init_channel(&d);
+    init_small_channel(&sa);
+    init_small_channel(&sb);
+    init_small_channel(&sc);
+    init_small_channel(&sd);
+    init_broadcast_channel(&bc, 2);
 
     // instantiate the processes
     Prefix prefix;    
@@ -145,18 +208,20 @@ int main(int argc, char ** argv)
     Consume consume;
 
     // connect them
-    prefix.in = in(&d);
-    prefix.out = out(&a);
-    delta.in = in(&a);
-    delta.out1 = out(&b);
-    delta.out2 = out(&c);
-    succ.in = in(&b);
-    succ.out = out(&d);
-    consume.in = in(&c);
+    prefix.in = (small ? in_small(&sd) : in(&d));
+    prefix.out = (small ? out_small(&sa) : out(&a));
+    delta.in = (small ? in_small(&sa) : in(&a));
+    delta.out1 = (small ? out_small(&sb) : out(&b));
+    delta.out2 = (small ? out_small(&sc) : out(&c));
+    succ.in = (small ? in_small(&sb) : in(&b));
+    succ.out = (small ? out_small(&sd) : out(&d));
+    consume.in = (small ? in_small(&sc) : in(&c));
 
     // and start them
     START(Prefix, &prefix, 1);
-    START(Delta, &delta, 1);
+    if (!broadcast) {
+        START(Delta, &delta, 1);
+    }
     START(Succ, &succ, 1);
     START(Consume, &consume, 1);
      
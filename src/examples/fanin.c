@@ -0,0 +1,132 @@
+
+/**
+ *  Fan-in of many clients to one server, either through one shared
+ *  channel (one guard on the server's side) or through a channel per
+ *  client and an ALT with a guard per client.  The server checks that
+ *  every client's requests arrive in order and reports the time per
+ *  request.
+ *  Usage: fanin [nclients [alt]]    (from 1 to MAX_CLIENTS)
+ *  e.g.   ./examples/fanin 1000; ./examples/fanin 1000 alt
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CLIENTS  1000        // most clients
+#define NREQUESTS    4000000     // # of requests server takes in all
+
+typedef struct Request {
+    int id;           // client sending request
+    int seq;          // client's request number
+} Request;
+
+static _Bool alt;                    // true for channel per client
+
+SharedChannel shared;                // clients to server (shared)
+Channel channels[MAX_CLIENTS];       // clients to server (channel each)
+Guard server_guards[MAX_CLIENTS];    // server's guards (channel each)
+
+int expected[MAX_CLIENTS];    // next request number expected per client
+
+PROCESS(Client)
+    Guard guards[1];
+    Request request;
+ENDPROC
+void Client_rtc(void *local)
+{
+    Client *client = (Client *)local;
+    if (initial()) {
+        init_alt(client->guards, 1);
+        if (alt) {
+            init_chanout_guard(&client->guards[0],
+                out(&channels[client->request.id]), &client->request);
+        } else {
+            init_sharedout_guard(&client->guards[0],
+                &shared, &client->request);
+        }
+        activate(&client->guards[0]);
+        client->request.seq = 0;
+    } else {
+        // just sent request, send next one
+        client->request.seq++;
+    }
+}
+
+PROCESS(Server)
+    int nclients;
+    Request request;  // request received
+    int count;        // # of requests received
+    Time t0;
+ENDPROC
+void Server_rtc(void *local)
+{
+    Server *server = (Server *)local;
+    if (initial()) {
+        int i;
+        if (alt) {
+            init_alt(server_guards, server->nclients);
+            for (i = 0; i < server->nclients; i++) {
+                init_chanin_guard(&server_guards[i], in(&channels[i]),
+                    &server->request, sizeof(server->request));
+                activate(&server_guards[i]);
+            }
+        } else {
+            init_alt(server_guards, 1);
+            init_sharedin_guard(&server_guards[0], &shared,
+                &server->request, sizeof(server->request));
+            activate(&server_guards[0]);
+        }
+        server->count = 0;
+        server->t0 = Now();
+    } else {
+        // check request is next from its client
+        int i = server->request.id;
+        if (server->request.seq != expected[i]) {
+            printf("Client %d: got %d, expected %d\n",
+                i, server->request.seq, expected[i]);
+            exit(1);
+        }
+        expected[i]++;
+        if (++server->count == NREQUESTS) {
+            Time t1 = Now();
+            printf("Time per request = %g nsec\n",
+                (double)(t1 - server->t0) / NREQUESTS);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nclients = (argc > 1 ? atoi(argv[1]) : 1000);
+    alt = (argc > 2 && strcmp(argv[2], "alt") == 0);
+    if (nclients < 1 || nclients > MAX_CLIENTS) {
+        printf("# of clients must be from 1 to %d\n", MAX_CLIENTS);
+        exit(1);
+    }
+    printf("%d clients, %s\n", nclients,
+        (alt ? "channel per client" : "shared channel"));
+
+    // room for the server and clients (and the idle process)
+    initialize(PROCESS_MEMORY(Server) + nclients*PROCESS_MEMORY(Client) + 
+        process_memory(0));
+
+    init_shared_channel(&shared);
+    int i;
+    for (i = 0; i < nclients; i++) {
+        init_channel(&channels[i]);
+    }
+
+    Server server;
+    server.nclients = nclients;
+    START(Server, &server, 1);
+    Client client;
+    for (i = 0; i < nclients; i++) {
+        client.request.id = i;
+        START(Client, &client, 1);
+    }
+
+    run();
+}
@@ -0,0 +1,118 @@
+
+/**
+ *  Two processes pass a message back and forth, each guarding its
+ *  input with a watchdog timeout that the next message always beats,
+ *  so every watchdog is set and then disabled.  Reports the time per
+ *  exchange and the timer counters: the timer is set again only when
+ *  an earlier watchdog is set, and the interrupts it then delivers
+ *  for watchdogs already disabled are counted as spurious.
+ *  Usage: kick [period]    (watchdog period in usec)
+ *  e.g.   ./examples/kick; ./examples/kick 1000000
+ */
+
+#include "microcsp.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RUN_TIME  2000000000ULL   // how long to run (nsec)
+
+static Time period;               // watchdog period
+static Time t0;                   // starting time
+
+Channel ping, pong;
+Guard player_guards[2][3];        // each player's guards
+
+PROCESS(Player)
+    Guard *guards;    // (kept out of the locals, to fit a memory block)
+    Timeout timeout;
+    ChanIn *input;
+    ChanOut *output;
+    int x;
+    long count;       // # of messages received
+    _Bool first;      // true for the player that sends first
+ENDPROC
+void Player_rtc(void *local)
+{
+    enum { IN=0, OUT, WATCHDOG };
+    Player *player = (Player *)local;
+    Guard *guards = player->guards;
+    if (initial()) {
+        init_alt(guards, 3);
+        init_chanin_guard(&guards[IN], player->input,
+            &player->x, sizeof(player->x));
+        init_chanout_guard(&guards[OUT], player->output, &player->x);
+        init_timeout_guard(&guards[WATCHDOG], &player->timeout,
+            Now() + period);
+        player->count = 0;
+        if (player->first) {
+            deactivate(&guards[IN]);
+            activate(&guards[OUT]);
+            deactivate(&guards[WATCHDOG]);
+        } else {
+            activate(&guards[IN]);
+            deactivate(&guards[OUT]);
+            activate(&guards[WATCHDOG]);
+        }
+        return;
+    }
+    switch (selected()) {
+    case WATCHDOG:
+        printf("Watchdog expired\n");
+        exit(1);
+
+    case OUT:
+        // sent message: wait for reply, watched by a timeout
+        activate(&guards[IN]);
+        deactivate(&guards[OUT]);
+        activate(&guards[WATCHDOG]);
+        init_timeout_guard(&guards[WATCHDOG], &player->timeout,
+            Now() + period);
+        break;
+
+    case IN:
+        // received message: send reply
+        if (++player->count % 1024 == 0 && Now() - t0 >= RUN_TIME) {
+            TimerStats stats;
+            get_timer_stats(&stats);
+            printf("%g nsec per exchange\n",
+                (double)(Now() - t0) / player->count);
+            printf("Timer armed %llu times, %llu interrupts "
+                "(%llu spurious)\n",
+                (unsigned long long)stats.arms,
+                (unsigned long long)stats.interrupts,
+                (unsigned long long)stats.spurious);
+            exit(0);
+        }
+        deactivate(&guards[IN]);
+        activate(&guards[OUT]);
+        deactivate(&guards[WATCHDOG]);
+        break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    period = (argc > 1 ? atoll(argv[1]) : 100000) * 1000;
+    printf("Watchdog period %llu usec\n", (unsigned long long)(period / 1000));
+
+    // room for the players (and the idle process)
+    initialize(2*PROCESS_MEMORY(Player) + process_memory(0));
+    init_channel(&ping);
+    init_channel(&pong);
+
+    Player a, b;
+    a.guards = player_guards[0];
+    a.input = in(&pong);
+    a.output = out(&ping);
+    a.first = true;
+    b.guards = player_guards[1];
+    b.input = in(&ping);
+    b.output = out(&pong);
+    b.first = false;
+    t0 = Now();
+    START(Player, &a, 1);
+    START(Player, &b, 1);
+
+    run();
+}
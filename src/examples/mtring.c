@@ -214,7 +214,9 @@ int main(int argc, char **argv)
     int cycles = CYCLES;
     int nrTokens = NTOKENS;
 
-    initialize(20520);
+    // room for the ring (and the idle process)
+    initialize((RING_SIZE-1)*PROCESS_MEMORY(Element) + 
+        PROCESS_MEMORY(Root) + process_memory(0));
 
     //  initialize the channels
     int i;
@@ -0,0 +1,104 @@
+
+/**
+ *  A control loop that wakes once a period, either with a periodic
+ *  timeout guard or with a timeout set afresh each period for a period
+ *  after the present time.  Every so often the loop works for longer
+ *  than a period.  Reports how far the last wakeup drifted from its
+ *  place on the schedule, the mean lateness of wakeups, and how many
+ *  periods were skipped (overruns).
+ *  Usage: periodic [period [work [oneshot]]]    (period and work in usec)
+ *  e.g.   ./examples/periodic 1000 2500; ./examples/periodic 1000 2500 oneshot
+ */
+
+#include "microcsp.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NPERIODS    5000      // # of periods to run for
+#define WORK_EVERY  1000      // long work once in this many wakeups
+
+static Time period;           // time between wakeups
+static Time work;             // how long the long work takes
+static _Bool oneshot;         // true to set a fresh timeout each period
+
+PROCESS(Loop)
+    Guard guards[1];
+    Timeout timeout;
+    Time t0;                  // time of period 0
+    long period_no;           // # of the period due at the wakeup
+    long wakeups;             // # of wakeups
+    long skipped;             // # of periods skipped
+    Time total_late;          // sum of lateness of wakeups
+ENDPROC
+void Loop_rtc(void *local)
+{
+    Loop *loop = (Loop *)local;
+    Time now = Now();
+    if (initial()) {
+        init_alt(loop->guards, 1);
+        activate(&loop->guards[0]);
+        loop->t0 = now + period;
+        loop->period_no = 0;
+        loop->wakeups = 0;
+        loop->skipped = 0;
+        loop->total_late = 0;
+        if (oneshot) {
+            init_timeout_guard(&loop->guards[0], &loop->timeout, loop->t0);
+        } else {
+            init_periodic_guard(&loop->guards[0], &loop->timeout,
+                loop->t0, period);
+        }
+        return;
+    }
+
+    // note lateness against the schedule
+    if (!oneshot) {
+        loop->skipped += overruns(&loop->timeout);
+        loop->period_no += overruns(&loop->timeout);
+    }
+    Time due = loop->t0 + loop->period_no * period;
+    loop->total_late += now - due;
+    loop->wakeups++;
+    loop->period_no++;
+    if (loop->period_no >= NPERIODS) {
+        printf("%ld wakeups: last %g usec off schedule, "
+            "mean lateness %g usec, %ld periods skipped\n",
+            loop->wakeups, (double)(now - due) / 1000,
+            (double)loop->total_late / loop->wakeups / 1000, loop->skipped);
+        exit(0);
+    }
+
+    // the control work (sometimes longer than a period)
+    if (loop->wakeups % WORK_EVERY == 0) {
+        while (Now() - now < work);
+    }
+
+    // a one-shot timeout drifts by the lateness of each wakeup
+    if (oneshot) {
+        init_timeout_guard(&loop->guards[0], &loop->timeout,
+            Now() + period);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    period = (argc > 1 ? atoll(argv[1]) : 1000) * 1000;
+    work = (argc > 2 ? atoll(argv[2]) : 0) * 1000;
+    oneshot = (argc > 3 && strcmp(argv[3], "oneshot") == 0);
+    if (period == 0) {
+        printf("Period must be nonzero\n");
+        exit(1);
+    }
+    printf("Period %llu usec, %s timeout\n",
+        (unsigned long long)(period / 1000),
+        (oneshot ? "one-shot" : "periodic"));
+
+    initialize(4096);
+
+    Loop loop;
+    START(Loop, &loop, 1);
+
+    run();
+}
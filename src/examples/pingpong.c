@@ -0,0 +1,110 @@
+/**
+ *  Bounces a token between two processes pinned to different
+ *  cores and reports the round-trip time.
+ *  Build with -DSMP=1; usage: pingpong [ncores]
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 1000000    // # of round trips
+
+Channel ping, pong;
+
+static Time t0;    // starting time
+
+PROCESS(Pinger)
+    Guard guards[2];
+    int token;
+ENDPROC
+void Pinger_rtc(void *local)
+{
+    // branch 0 for output, branch 1 for input
+    enum { OUT=0, IN };
+
+    Pinger *pinger = (Pinger *)local;
+    if (initial()) {
+        init_alt(pinger->guards, 2);
+        init_chanout_guard(&pinger->guards[OUT], out(&ping), &pinger->token);
+        init_chanin_guard(&pinger->guards[IN], in(&pong),
+            &pinger->token, sizeof(pinger->token));
+        pinger->token = 0;
+        activate(&pinger->guards[OUT]);
+        deactivate(&pinger->guards[IN]);
+        t0 = Now();
+
+    } else {
+        switch (selected()) {
+        case OUT:
+            // just sent token, await its return
+            deactivate(&pinger->guards[OUT]);
+            activate(&pinger->guards[IN]);
+            break;
+
+        case IN:
+            // token returned, report when all rounds done
+            if (++pinger->token == ROUNDS) {
+                Time t1 = Now();
+                printf("Round trip = %g nsec\n", (double)(t1 - t0) / ROUNDS);
+                exit(0);
+            }
+            activate(&pinger->guards[OUT]);
+            deactivate(&pinger->guards[IN]);
+            break;
+        }
+    }
+}
+
+PROCESS(Ponger)
+    Guard guards[2];
+    int token;
+ENDPROC
+void Ponger_rtc(void *local)
+{
+    // branch 0 for input, branch 1 for output
+    enum { IN=0, OUT };
+
+    Ponger *ponger = (Ponger *)local;
+    if (initial()) {
+        init_alt(ponger->guards, 2);
+        init_chanin_guard(&ponger->guards[IN], in(&ping),
+            &ponger->token, sizeof(ponger->token));
+        init_chanout_guard(&ponger->guards[OUT], out(&pong), &ponger->token);
+        activate(&ponger->guards[IN]);
+        deactivate(&ponger->guards[OUT]);
+
+    } else {
+        switch (selected()) {
+        case IN:
+            // just received token, send it back
+            deactivate(&ponger->guards[IN]);
+            activate(&ponger->guards[OUT]);
+            break;
+
+        case OUT:
+            activate(&ponger->guards[IN]);
+            deactivate(&ponger->guards[OUT]);
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ncores = (argc > 1 ? atoi(argv[1]) : 2);
+    printf("Ping-pong on %d cores\n", ncores);
+
+    initialize(32768);
+    set_cores(ncores);
+
+    init_channel(&ping);
+    init_channel(&pong);
+
+    Pinger pinger;
+    START_ON(Pinger, &pinger, 1, 0);
+    Ponger ponger;
+    START_ON(Ponger, &ponger, 1, 1 % ncores);
+
+    run();
+}
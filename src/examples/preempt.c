@@ -0,0 +1,122 @@
+
+/**
+ *  Passes numbered items up a chain of processes, each of higher
+ *  priority than the one before, so that every hop preempts the
+ *  sender.  Reports the deepest the stack grew below the lowest
+ *  process's RTC code and the time from a sender's RTC code returning
+ *  to its receiver's RTC code starting (preemption latency).
+ *  Usage: preempt
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NSTAGES  (PRI_MAX - 1)    // stages above the source (pri 2..PRI_MAX)
+#define NITEMS   1000000          // # of items passed up the chain
+
+Channel channel[NSTAGES];
+
+static uintptr_t base_sp;         // stack pointer in source's RTC code
+static uintptr_t min_sp;          // lowest stack pointer in any RTC code
+static Time stamp;                // time last sender's RTC code returned
+static Time total_latency;        // sum of latencies
+static Time max_latency;          // worst latency
+static long hops;                 // # of latencies summed
+
+/** Notes stack depth and latency of the hop that readied caller */
+static void note_hop(void)
+{
+    Time t = Now();
+    char here;
+    if ((uintptr_t)&here < min_sp) min_sp = (uintptr_t)&here;
+    Time latency = t - stamp;
+    total_latency += latency;
+    if (latency > max_latency) max_latency = latency;
+    hops++;
+}
+
+PROCESS(Source)
+    Guard guards[1];
+    int seq;
+ENDPROC
+void Source_rtc(void *local)
+{
+    Source *source = (Source *)local;
+    char here;
+    base_sp = min_sp = (uintptr_t)&here;
+    if (initial()) {
+        init_alt(source->guards, 1);
+        init_chanout_guard(&source->guards[0], out(&channel[0]), &source->seq);
+        activate(&source->guards[0]);
+        source->seq = 0;
+    } else {
+        source->seq++;
+    }
+    stamp = Now();
+}
+
+PROCESS(Stage)
+    Guard guards[2];
+    int index;        // stage number (priority index + 2)
+    int x;
+ENDPROC
+void Stage_rtc(void *local)
+{
+    enum { IN=0, OUT };
+    Stage *stage = (Stage *)local;
+    if (initial()) {
+        int i = stage->index;
+        init_alt(stage->guards, 2);
+        init_chanin_guard(&stage->guards[IN], in(&channel[i]),
+            &stage->x, sizeof(stage->x));
+        if (i + 1 < NSTAGES) {
+            init_chanout_guard(&stage->guards[OUT],
+                out(&channel[i+1]), &stage->x);
+        }
+        activate(&stage->guards[IN]);
+        deactivate(&stage->guards[OUT]);
+        return;
+    }
+    if (selected() == IN) {
+        note_hop();
+    }
+
+    // last stage only inputs
+    if (stage->index + 1 == NSTAGES) {
+        if (stage->x + 1 == NITEMS) {
+            printf("%d stages: deepest stack %lu bytes\n", NSTAGES,
+                (unsigned long)(base_sp - min_sp));
+            printf("Preemption latency: mean %g nsec, max %llu nsec\n",
+                (double)total_latency / hops,
+                (unsigned long long)max_latency);
+            exit(0);
+        }
+        stamp = Now();
+        return;
+    }
+    set_active(&stage->guards[IN], !is_active(&stage->guards[IN]));
+    set_active(&stage->guards[OUT], !is_active(&stage->guards[OUT]));
+    stamp = Now();
+}
+
+int main(int argc, char **argv)
+{
+    initialize(4096);
+
+    int i;
+    for (i = 0; i < NSTAGES; i++) {
+        init_channel(&channel[i]);
+    }
+
+    // higher stages first, so each is waiting when its input arrives
+    Stage stage;
+    for (i = NSTAGES - 1; i >= 0; i--) {
+        stage.index = i;
+        START(Stage, &stage, i + 2);
+    }
+    Source source;
+    START(Source, &source, 1);
+
+    run();
+}
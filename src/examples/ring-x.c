@@ -48,7 +48,8 @@ void Element_rtc(void *local)   // THE RING ELEMENT'S LOGIC
 }
 int main(int argc, char **argv)
 {
-    initialize(70*RING_SIZE+24);  // initialize the system
+    initialize(RING_SIZE*PROCESS_MEMORY(Element) // initialize the system
+        + process_memory(0));     // (elements and idle process)
     int i;                        // initialize the channels
     for (i = 0; i < RING_SIZE; i++) {
         init_channel(&channel[i]);
@@ -201,7 +201,9 @@ int main(int argc, char **argv)
     // read command-line arguments 
     int cycles = CYCLES;
 
-    initialize(20520);
+    // room for the ring (and the idle process)
+    initialize((RING_SIZE-1)*PROCESS_MEMORY(Element) + 
+        PROCESS_MEMORY(Root) + process_memory(0));
 
     //  initialize the channels
     int i;
@@ -7,6 +7,7 @@
 #include "microcsp.h"
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #define RING_SIZE 100   // # of processes in ring
 #define NS_PER_SEC  1000000000ULL
@@ -71,7 +72,11 @@ void Element_rtc(void *local)
 
 int main(int argc, char **argv)
 {
-    initialize(70*RING_SIZE+24);
+    // room for the elements (and the idle process)
+    initialize(RING_SIZE*PROCESS_MEMORY(Element) + process_memory(0));
+
+    // use direct handoff if asked ("ring1 1")
+    set_handoff(argc > 1 && atoi(argv[1]));
 
     // get the starting time
     t0 = Now();
@@ -0,0 +1,103 @@
+
+/**
+ *  A server multiplexing many clients with one replicated guard
+ *  (like occam's ALT i = 0 FOR n).  Each client sends numbered
+ *  requests on its own channel of a channel array; the server checks
+ *  that every client's requests arrive in order and reports the time
+ *  per request.
+ *  Usage: server [nclients]    (from 1 to MAX_CLIENTS)
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_CLIENTS  10000       // most clients
+#define NREQUESTS    4000000     // # of requests server takes in all
+
+ChannelArray requests;                                // clients to server
+Channel channels[MAX_CLIENTS];                        // (its channels)
+uint32_t bits[CHANNEL_ARRAY_WORDS(MAX_CLIENTS)];      // (its ready bits)
+
+int expected[MAX_CLIENTS];    // next request number expected per client
+
+PROCESS(Client)
+    Guard guards[1];
+    int id;           // client number, and channel of array
+    int seq;          // request number
+ENDPROC
+void Client_rtc(void *local)
+{
+    Client *client = (Client *)local;
+    if (initial()) {
+        init_alt(client->guards, 1);
+        init_arrayout_guard(&client->guards[0], &requests,
+            client->id, &client->seq);
+        activate(&client->guards[0]);
+        client->seq = 0;
+    } else {
+        // just sent request, send next one
+        client->seq++;
+    }
+}
+
+PROCESS(Server)
+    Guard guards[1];
+    int seq;          // request number received
+    int count;        // # of requests received
+    Time t0;
+ENDPROC
+void Server_rtc(void *local)
+{
+    Server *server = (Server *)local;
+    if (initial()) {
+        init_alt(server->guards, 1);
+        init_arrayin_guard(&server->guards[0], &requests,
+            &server->seq, sizeof(server->seq));
+        activate(&server->guards[0]);
+        server->count = 0;
+        server->t0 = Now();
+    } else {
+        // check request is next from its client
+        int i = selected_channel(&requests);
+        if (server->seq != expected[i]) {
+            printf("Client %d: got %d, expected %d\n",
+                i, server->seq, expected[i]);
+            exit(1);
+        }
+        expected[i]++;
+        if (++server->count == NREQUESTS) {
+            Time t1 = Now();
+            printf("Time per request = %g nsec\n",
+                (double)(t1 - server->t0) / NREQUESTS);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nclients = (argc > 1 ? atoi(argv[1]) : 1000);
+    if (nclients < 1 || nclients > MAX_CLIENTS) {
+        printf("# of clients must be from 1 to %d\n", MAX_CLIENTS);
+        exit(1);
+    }
+    printf("%d clients\n", nclients);
+
+    // room for the server and clients (and the idle process)
+    initialize(PROCESS_MEMORY(Server) + nclients*PROCESS_MEMORY(Client) + 
+        process_memory(0));
+
+    init_channel_array(&requests, channels, bits, nclients);
+
+    Server server;
+    START(Server, &server, 1);
+    Client client;
+    int i;
+    for (i = 0; i < nclients; i++) {
+        client.id = i;
+        START(Client, &client, 1);
+    }
+
+    run();
+}
@@ -0,0 +1,169 @@
+/**
+ *  Sends a token around each of several rings, each ring on its
+ *  own core, and reports the aggregate hop rate.
+ *  Build with -DSMP=1; usage: smpring [ncores [steal]]
+ *  If steal is nonzero, processes are started unpinned on the
+ *  cores in turn, and idle cores may steal them.
+ */
+
+#include "microcsp.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NRINGS     8          // # of rings
+#define RING_SIZE  100        // # of processes in each ring
+#define HOPS       1000000    // # of hops the token makes in each ring
+#define NS_PER_SEC 1000000000ULL
+
+Channel channel[NRINGS][RING_SIZE];
+Channel done[NRINGS];         // rings report completion here
+Guard collector_guards[NRINGS];   // collector's guards (kept out of 
+                                  // its locals, to fit a memory block)
+
+static Time t0;    //starting time
+
+PROCESS(Element)
+    Guard guards[3];
+    ChanIn *input;
+    ChanOut *output;
+    ChanOut *done;    // output to collector
+    int token;        // received/sent token
+    _Bool start;      // if true, start with output
+ENDPROC
+void Element_rtc(void *local)
+{
+    // branch 0 for input, branch 1 for output, 2 for done
+    enum { IN=0, OUT, DONE };
+
+    Element *element = (Element *)local;
+    if (initial()) {
+        // exactly one guard will be active at any one time
+        init_alt(element->guards, 3);
+        init_chanin_guard(&element->guards[IN],
+            element->input, &element->token, sizeof(element->token));
+        init_chanout_guard(&element->guards[OUT],
+            element->output, &element->token);
+        init_chanout_guard(&element->guards[DONE],
+            element->done, &element->token);
+
+        // if this element is the starter, start with output active,
+        // otherwise start with input active
+        element->token = 0;
+        set_active(&element->guards[IN], !element->start);
+        set_active(&element->guards[OUT], element->start);
+        deactivate(&element->guards[DONE]);
+
+    } else {
+        switch(selected()) {
+        case IN:
+            // incr token and prepare to output it, or if the
+            // token has made its hops, report to collector
+            element->token++;
+            deactivate(&element->guards[IN]);
+            if (element->token == HOPS) {
+                activate(&element->guards[DONE]);
+            } else {
+                activate(&element->guards[OUT]);
+            }
+            break;
+
+        case OUT:
+            // just output token, prepare to input it
+            activate(&element->guards[IN]);
+            deactivate(&element->guards[OUT]);
+            break;
+
+        case DONE:
+            terminate();
+            break;
+        }
+    }
+}
+
+PROCESS(Collector)
+    int token;
+    int count;        // # of rings finished
+ENDPROC
+void Collector_rtc(void *local)
+{
+    Collector *collector = (Collector *)local;
+    if (initial()) {
+        init_alt(collector_guards, NRINGS);
+        int i;
+        for (i = 0; i < NRINGS; i++) {
+            init_chanin_guard(&collector_guards[i], in(&done[i]),
+                &collector->token, sizeof(collector->token));
+            activate(&collector_guards[i]);
+        }
+        collector->count = 0;
+
+    } else {
+        // ring finished, report when all have
+        deactivate(&collector_guards[selected()]);
+        if (++collector->count == NRINGS) {
+            double sec = (double)(Now() - t0) / NS_PER_SEC;
+            printf("Elapsed time = %g sec\n", sec);
+            printf("Hops/sec = %g\n", (double)NRINGS * HOPS / sec);
+            SchedStats stats;
+            get_sched_stats(&stats);
+            printf("Steals = %llu, failed = %llu\n",
+                (unsigned long long)stats.steals,
+                (unsigned long long)stats.failed_steals);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ncores = (argc > 1 ? atoi(argv[1]) : 1);
+    _Bool steal = (argc > 2 && atoi(argv[2]) != 0);
+    printf("%d rings on %d cores%s\n", NRINGS, ncores, 
+        steal ? ", stealing" : "");
+
+    // room for the rings and collector (and each core's idle process)
+    initialize(NRINGS*RING_SIZE*PROCESS_MEMORY(Element) + 
+        PROCESS_MEMORY(Collector) + ncores*process_memory(0));
+    set_cores(ncores);
+
+    //  initialize the channels
+    int r, i;
+    for (r = 0; r < NRINGS; r++) {
+        init_channel(&done[r]);
+        for (i = 0; i < RING_SIZE; i++) {
+            init_channel(&channel[r][i]);
+        }
+    }
+
+    // connect the elements of the rings
+    static Element element[NRINGS][RING_SIZE];
+    for (r = 0; r < NRINGS; r++) {
+        for (i = 0; i < RING_SIZE; i++) {
+            Element *e = &element[r][i];
+            e->input = in(&channel[r][i]);
+            e->output = out(&channel[r][(i + 1) % RING_SIZE]);
+            e->done = out(&done[r]);
+            e->start = (i == RING_SIZE-1);
+        }
+    }
+
+    // start the collector, and each ring on its own core
+    // (or every process on the next core in turn)
+    Collector collector;
+    START_ON(Collector, &collector, 2, 0);
+    for (r = 0; r < NRINGS; r++) {
+        for (i = 0; i < RING_SIZE; i++) {
+            if (steal) {
+                START(Element, &element[r][i], 1);
+            } else {
+                START_ON(Element, &element[r][i], 1, r % ncores);
+            }
+        }
+    }
+
+    // get the starting time
+    t0 = Now();
+
+    run();
+}
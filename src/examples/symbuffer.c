@@ -0,0 +1,171 @@
+
+/**
+ *  Passes numbered items from a producer to a consumer through a
+ *  buffer of NSLOTS places, either one buffer process whose ALT
+ *  offers to input and to output at once (a symmetric ALT), or a
+ *  chain of NSLOTS one-place buffers, each alternately inputting and
+ *  outputting.  Reports the time per item and the number of buffer
+ *  process activations per item.
+ *  Usage: symbuffer [chain]
+ *  e.g.   ./examples/symbuffer; ./examples/symbuffer chain
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSLOTS   8             // buffer places
+#define NITEMS   2000000       // # of items passed
+
+Channel channel[NSLOTS+1];     // producer to buffer(s) to consumer
+
+static _Bool chain;            // true for chain of one-place buffers
+static long activations;       // # of buffer activations
+
+PROCESS(Producer)
+    Guard guards[1];
+    int seq;
+ENDPROC
+void Producer_rtc(void *local)
+{
+    Producer *producer = (Producer *)local;
+    if (initial()) {
+        init_alt(producer->guards, 1);
+        init_chanout_guard(&producer->guards[0],
+            out(&channel[0]), &producer->seq);
+        activate(&producer->guards[0]);
+        producer->seq = 0;
+    } else if (++producer->seq == NITEMS) {
+        terminate();
+    }
+}
+
+/** Buffer of NSLOTS places that inputs or outputs, whichever is ready */
+PROCESS(Buffer)
+    Guard guards[2];
+    AltState alt;     // (symmetric ALT)
+    int slots[NSLOTS];
+    int head;         // slot of next item to output
+    int count;        // # of items held
+    int in;           // item input
+    int out;          // item being output
+ENDPROC
+void Buffer_rtc(void *local)
+{
+    enum { IN=0, OUT };
+    Buffer *buffer = (Buffer *)local;
+    if (initial()) {
+        init_alt_symmetric(buffer->guards, 2, &buffer->alt);
+        init_chanin_guard(&buffer->guards[IN], in(&channel[0]),
+            &buffer->in, sizeof(buffer->in));
+        init_chanout_guard(&buffer->guards[OUT],
+            out(&channel[NSLOTS]), &buffer->out);
+        buffer->head = 0;
+        buffer->count = 0;
+    } else {
+        activations++;
+        switch (selected()) {
+        case IN:
+            buffer->slots[(buffer->head + buffer->count) % NSLOTS] =
+                buffer->in;
+            buffer->count++;
+            break;
+        case OUT:
+            buffer->head = (buffer->head + 1) % NSLOTS;
+            buffer->count--;
+            break;
+        }
+    }
+    buffer->out = buffer->slots[buffer->head];
+    set_active(&buffer->guards[IN], buffer->count < NSLOTS);
+    set_active(&buffer->guards[OUT], buffer->count > 0);
+}
+
+/** One-place buffer, one of a chain */
+PROCESS(Cell)
+    Guard guards[2];
+    int index;        // place in chain
+    int x;
+ENDPROC
+void Cell_rtc(void *local)
+{
+    enum { IN=0, OUT };
+    Cell *cell = (Cell *)local;
+    if (initial()) {
+        int i = cell->index;
+        init_alt(cell->guards, 2);
+        init_chanin_guard(&cell->guards[IN], in(&channel[i]),
+            &cell->x, sizeof(cell->x));
+        init_chanout_guard(&cell->guards[OUT], out(&channel[i+1]), &cell->x);
+        activate(&cell->guards[IN]);
+        deactivate(&cell->guards[OUT]);
+    } else {
+        activations++;
+        set_active(&cell->guards[IN], !is_active(&cell->guards[IN]));
+        set_active(&cell->guards[OUT], !is_active(&cell->guards[OUT]));
+    }
+}
+
+PROCESS(Consumer)
+    Guard guards[1];
+    int x;
+    int seq;
+    Time t0;
+ENDPROC
+void Consumer_rtc(void *local)
+{
+    Consumer *consumer = (Consumer *)local;
+    if (initial()) {
+        init_alt(consumer->guards, 1);
+        init_chanin_guard(&consumer->guards[0], in(&channel[NSLOTS]),
+            &consumer->x, sizeof(consumer->x));
+        activate(&consumer->guards[0]);
+        consumer->seq = 0;
+        consumer->t0 = Now();
+    } else {
+        if (consumer->x != consumer->seq) {
+            printf("Got %d, expected %d\n", consumer->x, consumer->seq);
+            exit(1);
+        }
+        if (++consumer->seq == NITEMS) {
+            Time t1 = Now();
+            printf("Time per item = %g nsec\n",
+                (double)(t1 - consumer->t0) / NITEMS);
+            printf("Buffer activations per item = %g\n",
+                (double)activations / NITEMS);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    chain = (argc > 1 && strcmp(argv[1], "chain") == 0);
+    printf("%d places, %s\n", NSLOTS,
+        (chain ? "chain of one-place buffers" : "one symmetric buffer"));
+
+    initialize(8192);
+
+    int i;
+    for (i = 0; i <= NSLOTS; i++) {
+        init_channel(&channel[i]);
+    }
+
+    Producer producer;
+    START(Producer, &producer, 1);
+    if (chain) {
+        Cell cell;
+        for (i = 0; i < NSLOTS; i++) {
+            cell.index = i;
+            START(Cell, &cell, 1);
+        }
+    } else {
+        Buffer buffer;
+        START(Buffer, &buffer, 1);
+    }
+    Consumer consumer;
+    START(Consumer, &consumer, 1);
+
+    run();
+}
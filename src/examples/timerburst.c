@@ -0,0 +1,90 @@
+
+/**
+ *  Many processes with periodic timeouts that all fall due at the
+ *  same moments.  Each round, every process notes how late it woke;
+ *  reports the mean lateness and, for the last process to wake in
+ *  each round, its mean and worst lateness (the tail).
+ *  Usage: timerburst [nprocs [period]]    (period in usec)
+ *  e.g.   ./examples/timerburst 500 10000
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_PROCS  2000        // most processes
+#define NROUNDS    200         // # of timeouts each process waits for
+
+static int nprocs;             // # of processes
+static Time period;            // time between rounds
+static Time base;              // time of round 0
+
+static Time tail[NROUNDS];     // latest wakeup per round (lateness)
+static Time total;             // sum of every wakeup's lateness
+static int done;               // # of processes finished
+
+PROCESS(Sleeper)
+    Guard guards[1];
+    Timeout timeout;
+    int round;
+ENDPROC
+void Sleeper_rtc(void *local)
+{
+    Sleeper *sleeper = (Sleeper *)local;
+    if (initial()) {
+        init_alt(sleeper->guards, 1);
+        activate(&sleeper->guards[0]);
+        sleeper->round = 0;
+    } else {
+        // note how late this wakeup is
+        Time late = Now() - (base + sleeper->round * period);
+        total += late;
+        if (late > tail[sleeper->round]) {
+            tail[sleeper->round] = late;
+        }
+        if (++sleeper->round == NROUNDS) {
+            if (++done < nprocs) {
+                terminate();
+                return;
+            }
+            Time sum = 0, worst = 0;
+            int r;
+            for (r = 0; r < NROUNDS; r++) {
+                sum += tail[r];
+                if (tail[r] > worst) worst = tail[r];
+            }
+            printf("Mean lateness %g nsec; last wakeup: mean %g nsec, "
+                "worst %llu nsec\n", (double)total / (nprocs * NROUNDS),
+                (double)sum / NROUNDS, (unsigned long long)worst);
+            exit(0);
+        }
+    }
+    init_timeout_guard(&sleeper->guards[0], &sleeper->timeout,
+        base + sleeper->round * period);
+}
+
+int main(int argc, char **argv)
+{
+    nprocs = (argc > 1 ? atoi(argv[1]) : 500);
+    period = (argc > 2 ? atoll(argv[2]) : 10000) * 1000;
+    if (nprocs < 1 || nprocs > MAX_PROCS) {
+        printf("# of processes must be from 1 to %d\n", MAX_PROCS);
+        exit(1);
+    }
+    printf("%d processes, period %llu usec\n",
+        nprocs, (unsigned long long)(period / 1000));
+
+    // room for the sleepers (and the idle process)
+    initialize(nprocs*PROCESS_MEMORY(Sleeper) + process_memory(0));
+
+    // first round once all have started
+    base = Now() + 100000000;
+
+    Sleeper sleeper;
+    int i;
+    for (i = 0; i < nprocs; i++) {
+        START(Sleeper, &sleeper, 1);
+    }
+
+    run();
+}
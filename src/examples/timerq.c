@@ -0,0 +1,154 @@
+/**
+ *  Compares the cost of cancelling and reinserting a timeout in
+ *  the timer wheel with the cost in the sorted list it replaced,
+ *  with 10, 1k and 100k timeouts pending.
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NS_PER_SEC 1000000000ULL
+#define OPS 2000           // cancel/reinsert pairs per measurement
+
+/** head of the sorted list */
+static Timeout *head;
+
+/** Inserts timeout in the sorted list (as the old timer queue did) */
+static void list_insert(Timeout *timeout)
+{
+    Timeout *prev = NULL;
+    Timeout *curr = head;
+    while (curr != NULL && timeout->time >= curr->time) {
+        prev = curr;
+        curr = curr->next;
+    }
+    timeout->next = curr;
+    if (prev == NULL) {
+        head = timeout;
+    } else {
+        prev->next = timeout;
+    }
+}
+
+/** Removes timeout from the sorted list (as the old timer queue did) */
+static void list_remove(Timeout *timeout)
+{
+    Timeout *prev = NULL;
+    Timeout *curr = head;
+    while (curr != NULL && curr->time < timeout->time) {
+        prev = curr;
+        curr = curr->next;
+    }
+    while (curr != NULL && curr != timeout) {
+        prev = curr;
+        curr = curr->next;
+    }
+    if (curr != NULL) {
+        if (prev == NULL) {
+            head = curr->next;
+        } else {
+            prev->next = curr->next;
+        }
+    }
+}
+
+/** Enables timeout in the list (as the old enable_timeout did) */
+static _Bool list_enable(Timeout *timeout)
+{
+    _Bool ready = (Now() >= timeout->time);
+    if (!ready) {
+        list_insert(timeout);
+    }
+    return ready;
+}
+
+/** Disables timeout in the list (as the old disable_timeout did) */
+static _Bool list_disable(Timeout *timeout)
+{
+    _Bool ready = (Now() >= timeout->time);
+    list_remove(timeout);
+    return ready;
+}
+
+/** Orders timeouts by time */
+static int compare(const void *a, const void *b)
+{
+    Time ta = ((Timeout *)a)->time;
+    Time tb = ((Timeout *)b)->time;
+    return (ta > tb) - (ta < tb);
+}
+
+/** Returns a random time between 10 and 20 seconds from t0 */
+static Time random_time(Time t0)
+{
+    return t0 + 10*NS_PER_SEC + (Time)((double)rand() / RAND_MAX * 10*NS_PER_SEC);
+}
+
+/** Returns nsec per cancel/reinsert pair with n timeouts in the list */
+static double time_list(Timeout *timeouts, int n)
+{
+    // build the list already sorted
+    int i;
+    Time t0 = Now();
+    for (i = 0; i < n; i++) {
+        timeouts[i].time = random_time(t0);
+    }
+    qsort(timeouts, n, sizeof(Timeout), compare);
+    head = &timeouts[0];
+    for (i = 0; i < n; i++) {
+        timeouts[i].next = (i+1 < n ? &timeouts[i+1] : NULL);
+    }
+
+    Time start = Now();
+    for (i = 0; i < OPS; i++) {
+        Timeout *timeout = &timeouts[rand() % n];
+        list_disable(timeout);
+        timeout->time = random_time(t0);
+        list_enable(timeout);
+    }
+    return (double)(Now() - start) / OPS;
+}
+
+/** Returns nsec per cancel/reinsert pair with n timeouts in the wheel */
+static double time_wheel(Timeout *timeouts, int n)
+{
+    int i;
+    Time t0 = Now();
+    for (i = 0; i < n; i++) {
+        timeouts[i].time = random_time(t0);
+        timeouts[i].link = NULL;
+        enable_timeout(&timeouts[i]);
+    }
+    Time start = Now();
+    for (i = 0; i < OPS; i++) {
+        Timeout *timeout = &timeouts[rand() % n];
+        disable_timeout(timeout);
+        timeout->time = random_time(t0);
+        enable_timeout(timeout);
+    }
+    double rate = (double)(Now() - start) / OPS;
+    for (i = 0; i < n; i++) {
+        disable_timeout(&timeouts[i]);
+    }
+    return rate;
+}
+
+int main(int argc, char **argv)
+{
+    // (returns with interrupts disabled, as enable_timeout requires)
+    initialize(1024);
+
+    static int pending[] = { 10, 1000, 100000 };
+    printf("%10s %14s %14s\n", "pending", "list ns/op", "wheel ns/op");
+    int k;
+    for (k = 0; k < sizeof(pending)/sizeof(pending[0]); k++) {
+        int n = pending[k];
+        Timeout *timeouts = (Timeout *)calloc(n, sizeof(Timeout));
+        if (timeouts == NULL) error("timerq calloc");
+        double list = time_list(timeouts, n);
+        double wheel = time_wheel(timeouts, n);
+        printf("%10d %14.1f %14.1f\n", n, list, wheel);
+        free(timeouts);
+    }
+}
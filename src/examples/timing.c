@@ -16,7 +16,7 @@ void Sender_rtc(void *local)
 { 
     Sender *sender = (Sender *)local;
     if (initial()) {
-        init_alt(&sender->guards[0], 1);
+        init_single(&sender->guards[0]);
         activate(&sender->guards[0]);
         sender->x = 0;
         init_chanout_guard(&sender->guards[0], out(&chan), &sender->x);
@@ -36,7 +36,7 @@ void Receiver_rtc(void *local)
     if (initial()) {
         receiver->t0 = Now();    
         printf("Receiver initial\n");
-        init_alt(&receiver->guards[0], 1);
+        init_single(&receiver->guards[0]);
         activate(&receiver->guards[0]);
         init_chanin_guard(
             &receiver->guards[0], in(&chan), &receiver->val, sizeof(int));
@@ -53,14 +53,14 @@ void Proc2_rtc(void *local)
 { 
     Proc2 *proc2 = (Proc2 *)local;
     if (initial()) {
-        init_alt(&proc2->guards[0], 2);
+        init_alt(&proc2->guards[0], 1);
         activate(&proc2->guards[0]);
-        init_timeout_guard(&proc2->guards[0], &proc2->timeout, Now()+ONE_SEC);
+        init_periodic_guard(&proc2->guards[0], &proc2->timeout,
+            Now()+ONE_SEC, ONE_SEC);
         proc2->which = 0;
     }  else {
         send_software_interrupt(proc2->which);
         proc2->which = (proc2->which + 1) % 2;
-        init_timeout_guard(&proc2->guards[0], &proc2->timeout, Now()+ONE_SEC);
     }
 }
 
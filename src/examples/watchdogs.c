@@ -0,0 +1,101 @@
+
+/**
+ *  Many watchdog processes, each with its own period from 10 msec to
+ *  1 sec, run for a few seconds with a given timer slack.  Reports how
+ *  often the timer was armed and interrupted, how many arms and
+ *  interrupts slack saved, and how late the watchdogs woke.
+ *  Usage: watchdogs [nprocs [slack]]    (slack in usec)
+ *  e.g.   ./examples/watchdogs 500 0; ./examples/watchdogs 500 1000
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_PROCS  2000           // most watchdogs
+#define RUN_TIME   5000000000ULL  // how long to run (nsec)
+
+static Time total_late;           // sum of every wakeup's lateness
+static Time max_late;             // worst lateness
+static long wakeups;              // # of wakeups
+
+PROCESS(Watchdog)
+    Guard guards[1];
+    Timeout timeout;
+    Time period;
+    Time due;
+ENDPROC
+void Watchdog_rtc(void *local)
+{
+    Watchdog *dog = (Watchdog *)local;
+    if (initial()) {
+        init_alt(dog->guards, 1);
+        activate(&dog->guards[0]);
+        dog->due = Now();
+    } else {
+        Time late = Now() - dog->due;
+        total_late += late;
+        if (late > max_late) max_late = late;
+        wakeups++;
+    }
+    dog->due += dog->period;
+    init_timeout_guard(&dog->guards[0], &dog->timeout, dog->due);
+}
+
+PROCESS(Monitor)
+    Guard guards[1];
+    Timeout timeout;
+ENDPROC
+void Monitor_rtc(void *local)
+{
+    Monitor *monitor = (Monitor *)local;
+    if (initial()) {
+        init_alt(monitor->guards, 1);
+        activate(&monitor->guards[0]);
+        init_timeout_guard(&monitor->guards[0], &monitor->timeout,
+            Now() + RUN_TIME);
+    } else {
+        TimerStats stats;
+        get_timer_stats(&stats);
+        printf("%ld wakeups: mean lateness %g usec, worst %g usec\n",
+            wakeups, (double)total_late / wakeups / 1000,
+            (double)max_late / 1000);
+        printf("Timer armed %llu times (%llu avoided), "
+            "%llu interrupts (%llu avoided)\n",
+            (unsigned long long)stats.arms,
+            (unsigned long long)stats.arms_avoided,
+            (unsigned long long)stats.interrupts,
+            (unsigned long long)stats.interrupts_avoided);
+        exit(0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int nprocs = (argc > 1 ? atoi(argv[1]) : 500);
+    Time slack = (argc > 2 ? atoll(argv[2]) : 1000) * 1000;
+    if (nprocs < 1 || nprocs > MAX_PROCS) {
+        printf("# of watchdogs must be from 1 to %d\n", MAX_PROCS);
+        exit(1);
+    }
+    printf("%d watchdogs, slack %llu usec\n",
+        nprocs, (unsigned long long)(slack / 1000));
+
+    // room for the watchdogs and monitor (and the idle process)
+    initialize(nprocs*PROCESS_MEMORY(Watchdog) + PROCESS_MEMORY(Monitor) + 
+        process_memory(0));
+    set_timer_slack(slack);
+
+    // periods spread from 10 msec to 1 sec (repeatably)
+    srand(1);
+    Watchdog dog;
+    int i;
+    for (i = 0; i < nprocs; i++) {
+        dog.period = 10000000ULL + (Time)(rand() % 990001) * 1000;
+        START(Watchdog, &dog, 1);
+    }
+    Monitor monitor;
+    START(Monitor, &monitor, 2);
+
+    run();
+}
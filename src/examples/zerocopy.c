@@ -0,0 +1,188 @@
+
+/**
+ *  Passes messages of a given size down a pipeline of stages, either
+ *  copying each message at every stage or moving it (zero-copy) as a
+ *  pool message, and reports the throughput.
+ *  Usage: zerocopy size [copy]    (size from 1 to MAX_SIZE bytes)
+ *  e.g.   for s in 64 1024 4096 65536; do
+ *             ./examples/zerocopy $s copy; ./examples/zerocopy $s; done
+ */
+
+#include "microcsp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NSTAGES    8                   // # of stages between source and sink
+#define MAX_SIZE   65536               // largest message size
+#define TOTAL_BYTES (1ULL << 32)       // bytes each run passes (about)
+#define NMESSAGES  (NSTAGES + 4)       // # of messages in pool
+
+Channel channel[NSTAGES+1];
+
+static unsigned int size;     // message size
+static _Bool copy;            // true to copy, false to move
+static int count;             // # of messages to send
+
+// data copied from stage to stage when copying
+static char source_data[MAX_SIZE];
+static char stage_data[NSTAGES+1][MAX_SIZE];
+
+// the message pool when moving
+static MessagePool pool;
+static char pool_memory[MESSAGE_POOL_LEN(MAX_SIZE, NMESSAGES)];
+
+PROCESS(Source)
+    Guard guards[1];
+    Message *msg;
+    int seq;
+ENDPROC
+void Source_rtc(void *local)
+{
+    Source *source = (Source *)local;
+    if (initial()) {
+        init_alt(source->guards, 1);
+        if (copy) {
+            init_chanout_guard(&source->guards[0],
+                out(&channel[0]), source_data);
+        } else {
+            init_msgout_guard(&source->guards[0],
+                out(&channel[0]), &source->msg);
+        }
+        activate(&source->guards[0]);
+        source->seq = 0;
+    } else {
+        if (++source->seq == count) {
+            terminate();
+            return;
+        }
+    }
+
+    // fill in next message
+    if (copy) {
+        *(int *)source_data = source->seq;
+    } else {
+        source->msg = get_message(&pool);
+        if (source->msg == NULL) error("Message pool empty");
+        source->msg->len = size;
+        *(int *)source->msg->data = source->seq;
+    }
+}
+
+PROCESS(Stage)
+    Guard guards[2];
+    Message *msg;
+    int index;       // stage number
+ENDPROC
+void Stage_rtc(void *local)
+{
+    // branch 0 for input, branch 1 for output
+    enum { IN=0, OUT };
+
+    Stage *stage = (Stage *)local;
+    if (initial()) {
+        int i = stage->index;
+        init_alt(stage->guards, 2);
+        if (copy) {
+            init_chanin_guard(&stage->guards[IN],
+                in(&channel[i]), stage_data[i], size);
+            init_chanout_guard(&stage->guards[OUT],
+                out(&channel[i+1]), stage_data[i]);
+        } else {
+            init_msgin_guard(&stage->guards[IN],
+                in(&channel[i]), &stage->msg);
+            init_msgout_guard(&stage->guards[OUT],
+                out(&channel[i+1]), &stage->msg);
+        }
+        activate(&stage->guards[IN]);
+        deactivate(&stage->guards[OUT]);
+    } else {
+        switch (selected()) {
+        case IN:
+            deactivate(&stage->guards[IN]);
+            activate(&stage->guards[OUT]);
+            break;
+        case OUT:
+            activate(&stage->guards[IN]);
+            deactivate(&stage->guards[OUT]);
+            break;
+        }
+    }
+}
+
+PROCESS(Sink)
+    Guard guards[1];
+    Message *msg;
+    int seq;
+    Time t0;
+ENDPROC
+void Sink_rtc(void *local)
+{
+    Sink *sink = (Sink *)local;
+    if (initial()) {
+        init_alt(sink->guards, 1);
+        if (copy) {
+            init_chanin_guard(&sink->guards[0],
+                in(&channel[NSTAGES]), stage_data[NSTAGES], size);
+        } else {
+            init_msgin_guard(&sink->guards[0],
+                in(&channel[NSTAGES]), &sink->msg);
+        }
+        activate(&sink->guards[0]);
+        sink->seq = 0;
+        sink->t0 = Now();
+    } else {
+        // check message is next in sequence
+        int seq;
+        if (copy) {
+            seq = *(int *)stage_data[NSTAGES];
+        } else {
+            seq = *(int *)sink->msg->data;
+            release_message(sink->msg);
+        }
+        if (seq != sink->seq) {
+            printf("Got %d, expected %d\n", seq, sink->seq);
+            exit(1);
+        }
+        if (++sink->seq == count) {
+            Time t1 = Now();
+            double sec = (double)(t1 - sink->t0) / 1e9;
+            printf("%s %u-byte messages: %g bytes/sec, %g nsec/message\n",
+                (copy ? "Copied" : "Moved"), size,
+                (double)size * count / sec, sec * 1e9 / count);
+            exit(0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size = (argc > 1 ? atoi(argv[1]) : 4096);
+    copy = (argc > 2 && strcmp(argv[2], "copy") == 0);
+    if (size < sizeof(int) || size > MAX_SIZE) {
+        printf("Size must be from %u to %d\n", (unsigned)sizeof(int), MAX_SIZE);
+        exit(1);
+    }
+    count = TOTAL_BYTES / size;
+    if (count > 2000000) count = 2000000;
+
+    initialize(4096);
+    init_message_pool(&pool, pool_memory, sizeof(pool_memory), size);
+
+    int i;
+    for (i = 0; i <= NSTAGES; i++) {
+        init_channel(&channel[i]);
+    }
+
+    Source source;
+    START(Source, &source, 1);
+    Stage stage[NSTAGES];
+    for (i = 0; i < NSTAGES; i++) {
+        stage[i].index = i;
+        START(Stage, &stage[i], 1);
+    }
+    Sink sink;
+    START(Sink, &sink, 1);
+
+    run();
+}
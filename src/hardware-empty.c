@@ -60,11 +60,36 @@ Time read_timer(int timerId)
 {  
 }
 
+/** Reads the clock, returning nanoseconds since initialization */
+Time read_clock()
+{
+}
+
 /** Creates a timer */
 void init_timer(int timerId, int intrsrc)
 {
 }
 
+/** Raises interrupt on this core */
+void raise_interrupt(int intrsrc)
+{
+}
+
+/** Waits for an interrupt */
+void wait_for_interrupt()
+{
+}
+
+/** Sends interprocessor interrupt to given core. */
+void interrupt_core(int core)
+{
+}
+
+/** Runs given function on each of cores 0..ncores-1. */
+void start_cores(int ncores, void (*fn)(int))
+{
+}
+
 /** Sends user interrupt via software. */
 void send_user_interrupt(int intrsrc)
 {
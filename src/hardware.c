@@ -16,21 +16,51 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE         // for thread affinity
 #include "internals/hardware.h"
 #include "atomic.h"
 #include "sched.h"
 #include <errno.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-
+#include <unistd.h>
+
+// 1 to mask interrupts in software, 0 to mask them with sigprocmask
+#ifndef VIRTUAL_INTR_MASK
+#define VIRTUAL_INTR_MASK 1
+#endif
+
+// 1 to read the clock from the calibrated time-stamp counter,
+// 0 to read it with clock_gettime
+#ifndef TSC_CLOCK
+#define TSC_CLOCK 0
+#endif
+#if TSC_CLOCK
+#include <x86intrin.h>
+#endif
+
+// 1 for the idle process to spin, 0 for it to sleep until an
+// interrupt (without SMP; idle SMP cores spin to steal work)
+#ifndef IDLE_SPIN
+#define IDLE_SPIN 0
+#endif
+
+#if SMP
+#if !VIRTUAL_INTR_MASK
+#error "SMP requires VIRTUAL_INTR_MASK"
+#endif
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 // number of signal handlers presently active
-static int activeHandlers;
+static PER_CORE int activeHandlers;
 
 // map from interrupt source to interrupt handler
 static INTERRUPT_HANDLER interrupt_handler[NINTR_SOURCES];
@@ -48,9 +78,43 @@ static sigset_t currently_blocked;
 // map from our timer id to Linux timer id
 static timer_t sys_timer_id[NTIMERS];
 
+#if VIRTUAL_INTR_MASK
+// true while interrupts are disabled
+//    DISABLE and ENABLE just clear and set this flag; a signal
+//    arriving while it is set is only noted in the pending set
+//    and is serviced when ENABLE clears the flag
+static PER_CORE volatile sig_atomic_t interrupts_disabled;
+
+// bit set of interrupt sources whose signals arrived while 
+// interrupts were disabled
+static PER_CORE _Atomic uint32_t pending_interrupts;
+#endif
+
+#if SMP
+// map from core number to the thread that runs the core
+static pthread_t core_thread[MAX_CORES];
+
+// function each core runs
+static void (*core_function)(int);
+#endif
+
 // nanoseconds per second
 #define NS_PER_SEC 1000000000ULL
 
+// monotonic clock reading at initialization (clock starts at zero)
+static Time clock_base;
+
+#if TSC_CLOCK
+// time-stamp counter reading at initialization
+static uint64_t tsc_base;
+
+// nanoseconds per time-stamp counter tick, found by calibration
+static double ns_per_tsc;
+
+// length of calibration interval in nanoseconds
+#define TSC_CALIBRATION 20000000ULL
+#endif
+
 /** Display according to format string */
 int Printf(char *fmt, ...)
 {
@@ -88,6 +152,67 @@ static void greater_than_or_equal_to(int signo, sigset_t *result)
     }
 }
 
+#if VIRTUAL_INTR_MASK
+
+/**
+ *  Calls the interrupt handler for the given interrupt source,
+ *  then the scheduler if no other handler is active.
+ */
+static void service_interrupt(int intrsrc)
+{
+    // INTERRUPTS DISABLED
+
+    // incr number of active handlers
+    activeHandlers += 1;
+
+    // get interrupt handler and call it
+    INTERRUPT_HANDLER handler = interrupt_handler[intrsrc];
+    if (handler != NULL) {
+        handler(intrsrc);
+    }
+
+    // decr number of active handlers
+    activeHandlers -= 1;
+
+    // if no handlers are active, schedule processes if necessary
+    // (the scheduler returns with interrupts disabled)
+    if (activeHandlers == 0) {
+        preempt();
+    }
+}
+
+/**
+ *  The one and only signal handler.
+ */
+static void handle_signal(int signo, siginfo_t *info, void *ucontext)
+{
+    /** arrive with no signals blocked */
+
+    // protect against unwanted compiler optimizations
+    SIGFENCE;
+
+    // if interrupts are disabled, just note the interrupt,
+    // ENABLE will service it
+    int intrsrc = signo - SIGRTMIN;    
+    if (interrupts_disabled) {
+        OR(&pending_interrupts, 1U << intrsrc);
+        return;
+    }
+
+    // disable interrupts and service this one
+    interrupts_disabled = true;
+    SIGFENCE;
+    service_interrupt(intrsrc);
+
+    // enable interrupts, servicing any that arrived meanwhile
+    ENABLE;
+
+    // protect against unwanted compiler optimizations
+    SIGFENCE;
+}
+
+#else
+
 /**
  *  The one and only signal handler.
  */
@@ -129,7 +254,7 @@ static void handle_signal(int signo, siginfo_t *info, void *ucontext)
         // since no handlers are active.
         // All signals are blocked now, but scheduler will
         // eventually enable all signals
-        schedule(currentPriority());
+        preempt();
     }
     
     // Restore previously blocked signals and install them as current.
@@ -147,6 +272,8 @@ static void handle_signal(int signo, siginfo_t *info, void *ucontext)
     SIGFENCE;
 }
 
+#endif
+
 /**
  *  Defines an interrupt handler for the given interrupt source.
  */
@@ -163,8 +290,13 @@ void define_signal_handler(int signo)
     struct sigaction action;
     action.sa_handler = NULL;          // call sigaction(), not signal()
     action.sa_sigaction = handle_signal;                  // the handler
+#if VIRTUAL_INTR_MASK
+    sigemptyset(&action.sa_mask);        // arrive with no signals blocked
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;       // call sigaction()
+#else
     action.sa_mask = all_signals;  // arrive with all RT signals blocked
     action.sa_flags = SA_SIGINFO;                    // call sigaction()
+#endif
     int r = sigaction(signo, &action, NULL);           // install driver
     if (r) error("define_signal_handler sigaction");
 }
@@ -194,6 +326,45 @@ void define_signal_handlers()
     }
 }
 
+#if VIRTUAL_INTR_MASK
+
+/** Enable interrupts */
+void enable_interrupts()
+{
+    SIGFENCE;
+    while (true) {
+
+        // service interrupts that arrived while disabled,
+        // highest priority (lowest source number) first
+        while (LOAD(&pending_interrupts) != 0) {
+            uint32_t pending = EXCH(&pending_interrupts, 0);
+            while (pending != 0) {
+                int intrsrc = __builtin_ctz(pending);
+                pending &= pending - 1;
+                service_interrupt(intrsrc);
+            }
+        }
+
+        // enable interrupts
+        interrupts_disabled = false;
+        SIGFENCE;
+
+        // done unless an interrupt slipped in before we enabled
+        if (LOAD(&pending_interrupts) == 0) break;
+        interrupts_disabled = true;
+        SIGFENCE;
+    }
+}
+
+/** Disable interrupts */
+void disable_interrupts()
+{
+    interrupts_disabled = true;
+    SIGFENCE;
+}
+
+#else
+
 /** Enable interrupts */
 void enable_interrupts()
 {
@@ -210,6 +381,8 @@ void disable_interrupts()
     if (r) error("disable_interrupts sigprocmask");
 }
 
+#endif
+
 /** Set interval timer for a single interval. */
 void set_timer_single(int timerId, Time interval)
 {
@@ -278,6 +451,41 @@ Time read_timer(int timerId)
     return t;
 }
 
+/** Reads the system monotonic clock in nanoseconds */
+static Time read_monotonic()
+{
+    // clock_gettime is served by the vDSO, so this is not a system call
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (r) error("read_monotonic clock_gettime");
+    return ((Time)ts.tv_sec * NS_PER_SEC) + ts.tv_nsec;
+}
+
+/** Reads the clock, returning nanoseconds since initialization */
+Time read_clock()
+{
+#if TSC_CLOCK
+    return (Time)((double)(__rdtsc() - tsc_base) * ns_per_tsc);
+#else
+    return read_monotonic() - clock_base;
+#endif
+}
+
+/** Sets the clock to zero, calibrating the time-stamp counter if used */
+static void init_clock()
+{
+    clock_base = read_monotonic();
+#if TSC_CLOCK
+    // count time-stamp counter ticks over a known interval
+    tsc_base = __rdtsc();
+    Time t;
+    do {
+        t = read_monotonic();
+    } while (t - clock_base < TSC_CALIBRATION);
+    ns_per_tsc = (double)(t - clock_base) / (double)(__rdtsc() - tsc_base);
+#endif
+}
+
 /** Creates a timer */
 void init_timer(int timerId, int intrsrc)
 {
@@ -291,10 +499,112 @@ void init_timer(int timerId, int intrsrc)
     se.sigev_signo = SIGRTMIN + intrsrc;
 
     // create timer and save its system id in map
-    int r = timer_create(CLOCK_REALTIME, &se, &sys_timer_id[timerId]);
+    int r = timer_create(CLOCK_MONOTONIC, &se, &sys_timer_id[timerId]);
     if (r) error("init_timer timer_create");
 }
 
+/** Raises interrupt on this core, to be serviced when
+ *  interrupts are next enabled. */
+void raise_interrupt(int intrsrc)
+{
+    // INTERRUPTS MUST BE DISABLED
+#if VIRTUAL_INTR_MASK
+    OR(&pending_interrupts, 1U << intrsrc);
+#else
+    int r = raise(SIGRTMIN + intrsrc);
+    if (r) error("raise_interrupt raise");
+#endif
+}
+
+/** Waits for an interrupt, which has been serviced on return */
+void wait_for_interrupt()
+{
+    // INTERRUPTS MUST BE ENABLED
+#if IDLE_SPIN
+    CPU_RELAX;
+#else
+    // the handler runs before pause returns; one that ran just
+    // before the call has done its work, so none is missed
+    pause();
+#endif
+}
+
+#if SMP
+
+/** Sends interprocessor interrupt to given core. */
+void interrupt_core(int core)
+{
+    int r = pthread_kill(core_thread[core], SIGRTMIN + INTR_INTERPROC);
+    if (r) error("interrupt_core pthread_kill");
+}
+
+/** Binds calling thread to a processor, if there is one for the core. */
+static void pin_core(int core)
+{
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (core < nprocs) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+}
+
+/** Body of the thread running a core other than core 0. */
+static void *run_core(void *arg)
+{
+    // interrupts start out disabled on every core (the thread starts
+    // with its signals blocked, till it has disabled them in software)
+    int core = (int)(intptr_t)arg;
+    DISABLE;
+    int r = pthread_sigmask(SIG_UNBLOCK, &all_signals, NULL);
+    if (r) error("run_core pthread_sigmask");
+    pin_core(core);
+    core_function(core);
+    return NULL;
+}
+
+/** Runs given function on each of cores 0..ncores-1. */
+void start_cores(int ncores, void (*fn)(int))
+{
+    // INTERRUPTS DISABLED
+    core_function = fn;
+    core_thread[0] = pthread_self();
+
+    // block signals in the new threads until they have disabled 
+    // interrupts, so none is serviced on a core not yet running
+    sigset_t previously_blocked;
+    int r = pthread_sigmask(SIG_BLOCK, &all_signals, &previously_blocked);
+    if (r) error("start_cores pthread_sigmask");
+    int core;
+    for (core = 1; core < ncores; core++) {
+        r = pthread_create(
+            &core_thread[core], NULL, run_core, (void *)(intptr_t)core);
+        if (r) error("start_cores pthread_create");
+    }
+    r = pthread_sigmask(SIG_SETMASK, &previously_blocked, NULL);
+    if (r) error("start_cores pthread_sigmask");
+    pin_core(0);
+    fn(0);
+}
+
+#else
+
+/** Sends interprocessor interrupt to given core (only one core). */
+void interrupt_core(int core)
+{
+    raise_interrupt(INTR_INTERPROC);
+}
+
+/** Runs given function on core 0 (only one core). */
+void start_cores(int ncores, void (*fn)(int))
+{
+    if (ncores != 1) error("start_cores: built without SMP");
+    fn(0);
+}
+
+#endif
+
 /** Sends user interrupt via software. */
 void send_user_interrupt(int intrsrc)
 {
@@ -340,7 +650,16 @@ void hardware_init()
     // disable interrupts
     DISABLE;    
 
+#if VIRTUAL_INTR_MASK
+    // masking is done in software, so let the RT signals in
+    r = sigprocmask(SIG_UNBLOCK, &all_signals, NULL);
+    if (r) error("hardware_init sigprocmask");
+#endif
+
     // define signal handlers for each simulated interrupt
     define_signal_handlers();
+
+    // start the clock
+    init_clock();
 }
 
@@ -3,18 +3,39 @@
 #ifndef  INTERNALS_HARDWARE_H
 #define  INTERNALS_HARDWARE_H
 
+#include "../atomic.h"
 #include "../timer.h"
 #include <stddef.h>
 
+/** Build with -DSMP=1 to run a scheduler on each of up to MAX_CORES
+ *  cores (threads).  Interrupt state is then kept per core, and
+ *  LOCK and UNLOCK guard data shared between cores. */
+#ifndef SMP
+#define SMP 0
+#endif
+#if SMP
+#define MAX_CORES       64
+#define PER_CORE        __thread
+#define LOCK(lock_p)    SPIN_LOCK(lock_p)
+#define UNLOCK(lock_p)  SPIN_UNLOCK(lock_p)
+#define INIT_LOCK(lock_p) SPIN_INIT(lock_p)
+#else
+#define MAX_CORES       1
+#define PER_CORE
+#define LOCK(lock_p)
+#define UNLOCK(lock_p)
+#define INIT_LOCK(lock_p)
+#endif
+
 /** timer ids */
 #define TIMER_0 0
 #define TIMER_1 1
 #define NTIMERS 2
 
 /** Interrupt sources */
-#define INTR_ELAPSED   0
+#define INTR_ELAPSED   0    // no longer used (clock is read directly)
 #define INTR_TIMEOUT   1
-#define INTR_INTERPROC 2    // for future use
+#define INTR_INTERPROC 2    // sent between cores (SMP)
 #define INTR_USER0     3
 #define INTR_USER1     4
 #define INTR_USER2     5
@@ -43,9 +64,26 @@ void set_timer_repeating(int timerId, Time interval);
 /** Read designated timer */
 Time read_timer(int timerId);
 
+/** Read monotonic clock (nanoseconds since initialization) */
+Time read_clock();
+
 /** Initialize timer */
 void init_timer(int timerId, int intrsrc);
 
+/** Raise interrupt on this core, to be serviced when interrupts
+ *  are next enabled. */
+void raise_interrupt(int intrsrc);
+
+/** Wait for an interrupt (sleeping unless built with -DIDLE_SPIN=1) */
+void wait_for_interrupt();
+
+/** Send interprocessor interrupt to given core (SMP) */
+void interrupt_core(int core);
+
+/** Run given function on each of cores 0..ncores-1, passing it
+ *  the core's number (SMP).  This thread becomes core 0. */
+void start_cores(int ncores, void (*fn)(int));
+
 /** Send user interrupt via software. */
 void send_user_interrupt(int intrsrc);
 
@@ -2,26 +2,118 @@
 #ifndef INTERNALS_SCHED_H
 #define INTERNALS_SCHED_H
 
+#include "../atomic.h"
+
 typedef struct Channel {
     Process *waiting;     
     void *src;          
+    int index;            // branch of waiting inputter's ALT
 } Channel;
 
 typedef struct ChanIn {
     Process *waiting;
     void *src;
+    int index;            // branch of waiting inputter's ALT
 } ChanIn;
 
 typedef struct ChanOut {
     Process *waiting;
     void *src;
+    int index;            // branch of waiting inputter's ALT
 } ChanOut;
 
+/** Most bytes a SmallChannel carries */
+#define SMALL_MSG_MAX 16
+
+typedef struct SmallChannel {
+    Process *waiting;     
+    void *src;                                   // (data, once output)
+    int index;                            // branch of waiting inputter's ALT
+    uint64_t data[SMALL_MSG_MAX / sizeof(uint64_t)];   // message
+} SmallChannel;
+
+typedef struct BatchChannel {
+    Process *waiting;     
+    void *src;                            // (items, while writer waits)
+    int index;                            // branch of waiting inputter's ALT
+    unsigned int size;                    // size of an item in bytes
+    unsigned int count;                   // # of items writer offers
+    unsigned int taken;                   // # of items last input
+} BatchChannel;
+
 typedef struct InterruptChannel {
     Process *waiting;
     int count;
+    int index;            // branch of waiting process's ALT
 } InterruptChannel;
 
+typedef struct BufferedChannel {
+    Process *reader;        // reader waiting for an item
+    Process *writer;        // writer waiting for space
+    int reader_index;       // branch of reader's ALT
+    int writer_index;       // branch of writer's ALT
+    char *buffer;           // ring buffer of capacity items
+    unsigned int size;      // size of an item in bytes
+    unsigned int capacity;  // # of items buffer holds
+    unsigned int first;     // index of oldest item in buffer
+    unsigned int count;     // # of items in buffer
+    Spinlock lock;          // guards the above when there are several cores
+} BufferedChannel;
+
+typedef struct ChannelArray {
+    Channel *channels;      // the channels
+    uint32_t *ready;        // bit per channel with an outputter waiting,
+                            // then bit per nonzero word of those bits
+    int size;               // # of channels
+    int nwords;             // # of words of channel bits
+    int nready;             // # of channels with an outputter waiting
+    int selected;           // channel last selected
+    Process *reader;        // reader waiting for an outputter
+    int reader_index;       // branch of reader's ALT
+    Spinlock lock;          // guards the above when there are several cores
+} ChannelArray;
+
+typedef struct SharedChannel {
+    Process *reader;        // reader waiting for a writer
+    int reader_index;       // branch of reader's ALT
+    Process *first;         // oldest writer waiting (linked through
+    Process *last;          //   their next fields) and newest
+    Spinlock lock;          // guards the above when there are several cores
+} SharedChannel;
+
+/** Most readers a BroadcastChannel can have */
+#define BROADCAST_MAX 8
+
+typedef struct BroadcastChannel {
+    Process *writer;        // writer waiting for readers to take data
+    void *src;              // (data, while writer waits)
+    unsigned int nreaders;  // # of readers
+    uint32_t pending;       // bit set of readers yet to take data
+    Process *readers[BROADCAST_MAX];   // readers waiting for data
+    int reader_index[BROADCAST_MAX];   // branches of readers' ALTs
+    Spinlock lock;          // guards the above when there are several cores
+} BroadcastChannel;
+
+typedef struct MessagePool MessagePool;
+
+typedef struct Message Message;
+typedef struct Message {
+    Message *next;          // next free message in pool
+    MessagePool *pool;      // pool the message belongs to
+    unsigned int len;       // # of bytes of data in use
+    char data[];            // the data (the pool's size in bytes)
+} Message;
+
+typedef struct MessagePool {
+    Message *free;          // messages not in use
+    unsigned int size;      // # of data bytes in each message
+    Spinlock lock;          // guards the above when there are several cores
+} MessagePool;
+
+/** Bytes one message with given size of data takes in a pool */
+#define MESSAGE_STRIDE(size) \
+    ((sizeof(Message) + (size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
 typedef struct Guard {
     union {
         struct {
@@ -32,22 +124,79 @@ typedef struct Guard {
         struct {
             Channel *channel;
             void *src;
+            unsigned int len;   // (small channels only)
         } chanout;
         Timeout *timeout;
         struct {
             InterruptChannel *channel;
             void *dest;
         } interrupt;
+        struct {
+            BufferedChannel *channel;
+            void *addr;     // destination for input, source for output
+        } buffered;
+        struct {
+            SharedChannel *channel;
+            void *addr;     // destination for input, source for output
+            unsigned int len;
+        } shared;
+        struct {
+            BroadcastChannel *channel;
+            void *addr;     // destination for input, source for output
+            uint16_t len;   // (input only)
+            uint16_t reader;// reader #, 0 to nreaders-1 (input only)
+        } broadcast;
+        struct {
+            BatchChannel *channel;
+            void *addr;     // destination for input, source for output
+            unsigned int n; // most items for input, items for output
+        } batch;
+        struct {
+            ChannelArray *array;
+            void *addr;     // destination for input, source for output
+            unsigned int n; // length for input, channel # for output
+        } replicated;
     };
     int8_t type;
     _Bool active;
 } Guard;
+
+// State of an event-driven or symmetric ALT, kept in the process's 
+// locals so plain ALTs don't carry it in the process record
+typedef struct AltState {
+    Guard *guards;
+    uint32_t enabled;       // branches enabled (bit per guard)
+    uint32_t ready;         // branches marked ready by partners
+    uint32_t dirty;         // branches to re-enable (persistent)
+    Channel *claim;         // (symmetric) NULL while no branch is 
+                            // committed, CLAIM_SELF once the process 
+                            // has chosen one, or the channel through 
+                            // which an inputter took one of its outputs
+    _Bool event;            // true if event-driven
+    _Bool persistent;       // true if guards stay enabled between 
+                            // activations
+    _Bool offering;         // (symmetric) true while outputs are 
+                            // enabled along with other guards
+} AltState;
 // guard type      
 #define GUARD_CHANIN     0
 #define GUARD_CHANOUT    1
 #define GUARD_SKIP       2
 #define GUARD_TIMEOUT    3
 #define GUARD_INTERRUPT  4
+#define GUARD_BUFIN      5
+#define GUARD_BUFOUT     6
+#define GUARD_MSGIN      7
+#define GUARD_SMALLIN    8
+#define GUARD_SMALLOUT   9
+#define GUARD_ARRAYIN   10
+#define GUARD_ARRAYOUT  11
+#define GUARD_SHAREDIN  12
+#define GUARD_SHAREDOUT 13
+#define GUARD_BCASTIN   14
+#define GUARD_BCASTOUT  15
+#define GUARD_BATCHIN   16
+#define GUARD_BATCHOUT  17
 
 /** Returns priority of current process. */
 int currentPriority();
@@ -55,7 +204,18 @@ int currentPriority();
 /** Makes given process ready if it isn't already. */
 void readyProcessIfNecessary(Process *proc);
 
+/** Marks given branch of process's ALT ready, and makes
+ *  the process ready if it isn't already. */
+void readyBranch(Process *proc, int index);
+
+/** Makes the processes of a list of expired timeouts ready. */
+void readyTimeouts(Timeout *list);
+
 /** Schedules the highest priority ready process. */
 void schedule(int prev_priority);
 
+/** Dispatches processes readied above the current one's priority,
+ *  once interrupt handlers are done. */
+void preempt();
+
 #endif
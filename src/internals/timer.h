@@ -8,14 +8,15 @@ typedef struct Process Process;
 /** Timeout descriptor */
 typedef struct Timeout Timeout;
 typedef struct Timeout {
-    Timeout *next;        // next timeout in timer's list
-    Process *proc;        // process expecting timeout 
-    Time time;            // expiration time
+    Timeout *next;          // next timeout in timer wheel slot
+    Timeout **link;         // link to this timeout (NULL if not in wheel)
+    Process *proc;          // process expecting timeout 
+    Time time;              // expiration time
+    Time period;            // time between expirations (0 if one-shot)
+    unsigned int overruns;  // # of periods skipped when last selected
+    int index;              // branch of process's ALT
 } Timeout;
 
-/** Interval between elapsed-time interrupts */
-#define TICK 1000000000ULL
-
 /** Enables timeout guard for alternation,
  *  returning true if guard is ready */
 _Bool enable_timeout(Timeout *timeout);
@@ -24,6 +25,10 @@ _Bool enable_timeout(Timeout *timeout);
  *  returning true if guard is ready */
 _Bool disable_timeout(Timeout *timeout);
 
+/** Advances periodic timeout, which has expired, to its next period
+ *  after the present time */
+void next_period(Timeout *timeout);
+
 /** Initializes the timer module */
 void timer_init();
 
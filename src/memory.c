@@ -18,6 +18,7 @@
 
 #include "memory.h"
 #include "hardware.h"
+#include "sched.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -36,20 +37,30 @@ static uint16_t procmemlen[NALLOC] =
 static uint32_t taillen;    // in bytes
 static char *tail;                 
 
+#if SMP
+// guards the above when there are several cores
+static Spinlock memlock;
+#endif
+
 /**
  * Find index of smallest allocation >= given size (bytes)
  */
 unsigned int find_mem_index(unsigned int size)
 {
     int8_t i;
-    for (i = 0; procmemlen[i]; i++) {
+    for (i = 0; i < NALLOC; i++) {
         if (procmemlen[i] >= size)
-            break;
+            return i;
     }
-    if (procmemlen[i])
-        return i;
-    else
-        error("No memory block large enough");
+    error("No memory block large enough");
+}
+
+/**
+ * Length of smallest allocation >= given size (bytes)
+ */
+unsigned int mem_block_length(unsigned int size)
+{
+    return procmemlen[find_mem_index(size)];
 }
 
 /** 
@@ -60,6 +71,7 @@ unsigned int find_mem_index(unsigned int size)
 char *allocate_mem(unsigned int index)
 {
     DISABLE;
+    LOCK(&memlock);
     ChainedBlock_p block = procmemlist[index];
     if (block != NULL)
     {
@@ -85,6 +97,7 @@ char *allocate_mem(unsigned int index)
         }
     }
     
+    UNLOCK(&memlock);
     ENABLE;
     return (char *)block;
 }
@@ -98,9 +111,11 @@ void release_mem(unsigned int index, char *addr)
 {
     // put released block at head of list for its size
     DISABLE;
+    LOCK(&memlock);
     ChainedBlock_p block = (ChainedBlock_p)addr;
     block->next = procmemlist[index];
     procmemlist[index] = block;
+    UNLOCK(&memlock);
     ENABLE;
 }
 
@@ -123,3 +138,61 @@ void memory_init(uint32_t memlen)
 }
 
 
+
+/**
+ * Initializes a pool of messages.
+ * input:    pool     the pool
+ *           memory   memory to carve the messages from
+ *           memlen   length of memory in bytes
+ *           size     # of data bytes in each message
+ */
+void init_message_pool(MessagePool *pool, 
+    void *memory, unsigned int memlen, unsigned int size)
+{
+    unsigned int stride = MESSAGE_STRIDE(size);
+    if (memlen < stride) error("init_message_pool memory too small");
+    pool->free = NULL;
+    pool->size = size;
+    INIT_LOCK(&pool->lock);
+    char *p;
+    for (p = (char *)memory; p + stride <= (char *)memory + memlen; 
+         p += stride) {
+        Message *msg = (Message *)p;
+        msg->pool = pool;
+        msg->len = 0;
+        msg->next = pool->free;
+        pool->free = msg;
+    }
+}
+
+/**
+ * Takes a message from a pool.
+ * output:   the message, or NULL if the pool is empty
+ */
+Message *get_message(MessagePool *pool)
+{
+    DISABLE;
+    LOCK(&pool->lock);
+    Message *msg = pool->free;
+    if (msg != NULL) {
+        pool->free = msg->next;
+        msg->len = 0;
+    }
+    UNLOCK(&pool->lock);
+    ENABLE;
+    return msg;
+}
+
+/**
+ * Returns a message to its pool.
+ */
+void release_message(Message *msg)
+{
+    MessagePool *pool = msg->pool;
+    DISABLE;
+    LOCK(&pool->lock);
+    msg->next = pool->free;
+    pool->free = msg;
+    UNLOCK(&pool->lock);
+    ENABLE;
+}
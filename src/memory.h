@@ -46,6 +46,11 @@ typedef struct ChainedBlock {
  */
 unsigned int find_mem_index(uint32_t size);
 
+/*
+ * Length of smallest allocation >= given size
+ */
+unsigned int mem_block_length(uint32_t size);
+
 /* 
  * Allocate block of length implied by index
  * input:   index    1..NALLOC-1
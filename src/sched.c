@@ -27,13 +27,34 @@
 
 /** Alternation descriptor */
 typedef struct Alternation {
-    Guard *guards;    // guards
-    uint8_t nrGuards; // # of guards
-    uint8_t index;    // current or selected ready branch
-    uint8_t count;    // running branch count
+    union {
+        Guard *guards;    // guards
+        uintptr_t state;  // (event-driven or symmetric) the AltState,
+                          // which points to the guards, | ALT_STATE
+    };
+    uint16_t nrGuards; // # of guards
+    uint16_t index;   // current or selected ready branch
+    uint16_t count;   // running branch count
     _Bool alt_pri;    // true if alt pri
 } Alternation;
 
+/** claim of a symmetric ALT that has chosen its own branch */
+#define CLAIM_SELF  ((Channel *)1)
+
+/** returned by disable_alt when no branch turned out to be ready
+ *  (enable the ALT again), or when the process must wait for the 
+ *  inputter that claimed it to finish taking its output */
+#define ALT_RETRY   ((Process *)1)
+#define ALT_WAIT    ((Process *)2)
+
+/** most guards an event-driven ALT can have */
+#define ALT_EVENT_MAX 32
+
+/** tag on an Alternation's guards word when it holds the AltState of 
+ *  an event-driven or symmetric ALT (so a plain ALT's record needs no
+ *  room for it) */
+#define ALT_STATE   1
+
 /** Process record */
 typedef struct Process Process;
 typedef struct Process {
@@ -41,8 +62,15 @@ typedef struct Process {
     void (*rtc)(void *);     // function called each time process executes
     Alternation alt;         // the process's ALT record
     uint8_t index;           // memory class of this process
-    int8_t pri;              // priority of this process
+    uint8_t pri;             // priority of this process
     int8_t state;            // scheduling state
+    _Bool handoff;           // if true, run process directly when readied
+                             // by a partner (direct handoff)
+#if SMP
+    uint8_t core;            // home core of this process
+    _Bool pinned;            // if true, process never leaves home core
+    Process *prev;           // previous process in ready queue
+#endif
 } Process;
 // process state
 #define PROC_INITIAL   0    // new process
@@ -51,18 +79,24 @@ typedef struct Process {
 #define PROC_WAITING   3    // waiting for a ready branch
 #define PROC_READY     4    // a branch is ready
 #define PROC_DONE      5    // process has terminated
+#define PROC_SELECTED  6    // branch selected, RTC code yet to run
 
 /** Develops pointer to process's local variables given process record */
 #define LOCAL(proc)  ((char *)proc + proc_offset)
 
-/** currently executing process */
-static Process *current;
+/** currently executing process (on this core) */
+static PER_CORE Process *current;
 
-/** bit set of priority levels with processes in ready queue */
-static uint8_t priority_mask;
-
-/** priority-to-mask translation table */
-static uint8_t mask[] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+/** 
+ *  Ready bitmap geometry.  Bit p%32 of word p/32 is set when level p
+ *  has a ready process.  With more than 32 levels, bit w of a summary
+ *  word is set when word w is nonzero, so the highest ready level is
+ *  found with two bit scans at most.
+ */
+#define PRI_WORDS  ((PRI_LEVELS + 31) / 32)
+#if PRI_LEVELS < 2 || PRI_LEVELS > 256
+#error "PRI_LEVELS must be from 2 to 256"
+#endif
 
 /** ready queue descriptor */
 typedef struct ReadyQ {
@@ -70,8 +104,51 @@ typedef struct ReadyQ {
     Process *tail;
 } ReadyQ;
 
-/** the ready queues, one per priority level */
-static ReadyQ readyQ[PRI_MAX+1];
+/** core descriptor */
+typedef struct Core {
+    ReadyQ readyQ[PRI_LEVELS];   // the ready queues, one per priority level
+    uint32_t priority_mask[PRI_WORDS];  // bit set of levels with processes 
+                                        // in ready queue
+#if PRI_WORDS > 1
+    uint32_t priority_summary;  // bit set of nonzero priority_mask words
+#endif
+    int16_t running;          // priority of process running on core
+    Process *idle;            // core's idle process
+    Spinlock lock;            // guards ready queues and mask
+    uint64_t steals;          // # of processes stolen by this core
+    uint64_t failed_steals;   // # of steal attempts that found nothing
+    int handoffs;             // # of consecutive direct handoffs
+    uint64_t total_handoffs;  // # of direct handoffs
+    _Bool in_rtc;             // true while a process's RTC code runs
+    _Bool preempt;            // true if a process may have been readied
+                              // here above the current one's priority
+} Core;
+
+/** most consecutive direct handoffs on a core before a readied
+ *  partner goes to the tail of its queue like any other */
+#define HANDOFF_MAX 16
+
+/** direct-handoff policy for processes started from now on */
+static _Bool handoff_default;
+
+/** the cores */
+static Core cores[MAX_CORES];
+
+/** this core */
+static PER_CORE Core *core = &cores[0];
+
+/** number of cores in use */
+static int ncores = 1;
+
+/** home core for next process started */
+static int next_core;
+
+#if SMP
+/** Develops pointer to process's home core */
+#define HOME(proc)  (&cores[(proc)->core])
+#else
+#define HOME(proc)  (&cores[0])
+#endif
 
 /** offset of process's local variables from start of allocation */
 static size_t proc_offset;
@@ -79,64 +156,73 @@ static size_t proc_offset;
 /** map from user interrupt number to channel */
 static InterruptChannel *channel_for_interrupt[NINTR_SOURCES-INTR_USER0];
 
-/** Returns highest priority that has a ready process 
+/** Shows a ready process at given level on given core */
+static inline void show_ready(Core *c, int pri)
+{
+    // CORE LOCKED
+    c->priority_mask[pri / 32] |= (1U << (pri % 32));
+#if PRI_WORDS > 1
+    c->priority_summary |= (1U << (pri / 32));
+#endif
+}
+
+/** Shows no ready process at given level on given core */
+static inline void show_not_ready(Core *c, int pri)
+{
+    // CORE LOCKED
+    c->priority_mask[pri / 32] &= ~(1U << (pri % 32));
+#if PRI_WORDS > 1
+    if (c->priority_mask[pri / 32] == 0) {
+        c->priority_summary &= ~(1U << (pri / 32));
+    }
+#endif
+}
+
+/** Returns true if given level on given core has a ready process */
+static inline _Bool is_ready(Core *c, int pri)
+{
+    return (LOAD(&c->priority_mask[pri / 32]) & (1U << (pri % 32))) != 0;
+}
+
+/** Returns true if given core has a ready process above the idle level */
+static inline _Bool ready_above_idle(Core *c)
+{
+#if PRI_WORDS > 1
+    return (LOAD(&c->priority_summary) & ~1U) != 0 ||
+           (LOAD(&c->priority_mask[0]) & ~(1U << PRI_MIN)) != 0;
+#else
+    return (LOAD(&c->priority_mask[0]) & ~(1U << PRI_MIN)) != 0;
+#endif
+}
+
+/** Returns highest priority that has a ready process on given core
  *  (Returns zero if none on ready queues) */
-static int highest_ready()
+static inline int highest_ready_on(Core *c)
 {
-    /* -------------------------- *
-     | constant-time, low-storage |
-     | assumes 8 priority levels  |
-     * -------------------------- */ 
+    /* --------------------------------- *
+     | constant-time: at most two scans  |
+     * --------------------------------- */
     // INTERRUPTS MUST BE DISABLED 
-    int level;
-    unsigned register int ready = priority_mask;
-    if (ready & 0b11110000) {
-        if (ready & 0b11000000) {
-            if (ready & 0b10000000) {
-                level = 7;
-            } else {
-                level = 6;
-            }
-        } else {
-            if (ready & 0b00100000) {
-                level = 5;
-            } else {
-                level = 4;
-            }
-        }
-    } else {
-        if (ready & 0b00001100) {
-            if (ready & 0b00001000) {
-                level = 3;
-            } else {
-                level = 2;
-            }
-        } else {
-            if (ready & 0b00000010) {
-                level = 1;
-            } else {
-                level = 0;
-            }
-        }
-    }
-    
-    /*****
-    int level = 0;
-    if (mask & 0xF0) {
-        mask >>= 4;
-        level += 4; 
-    } 
-    if (mask & 0x0C) {
-        mask >>= 2;
-        level += 2;
-    }
-    if (mask & 0x02) {
-        level += 1;
-    }
-    *****/
+#if PRI_WORDS > 1
+    uint32_t words = LOAD(&c->priority_summary);
+    if (words == 0) return 0;
+    int w = 31 - __builtin_clz(words);
+    uint32_t ready = LOAD(&c->priority_mask[w]);
+    if (ready == 0) return 0;      // (stolen meanwhile)
+    return (w * 32) + (31 - __builtin_clz(ready));
+#else
+    uint32_t ready = LOAD(&c->priority_mask[0]);
+    if (ready == 0) return 0;
+    return 31 - __builtin_clz(ready);
+#endif
+}
 
-    return level;
-    // level 0 (the idle process) is always ready
+/** Returns highest priority that has a ready process on this core
+ *  (Returns zero if none on ready queues) */
+static int highest_ready()
+{
+    // INTERRUPTS MUST BE DISABLED 
+    return highest_ready_on(core);
 }
 
 /**
@@ -146,34 +232,100 @@ static int highest_ready()
 static Process *take(int pri)
 {
     // INTERRUPTS MUST BE DISABLED
-    ReadyQ *queue = &readyQ[pri];
+    Core *c = core;
+    LOCK(&c->lock);
+    ReadyQ *queue = &c->readyQ[pri];
     Process *proc = queue->head;
     if (proc != NULL) {
         queue->head = proc->next;
         if (queue->head == NULL) {
             queue->tail = NULL;
-            priority_mask &= ~mask[pri];  // show no ready process at level pri
+            show_not_ready(c, pri);  // show no ready process at level pri
+#if SMP
+        } else {
+            queue->head->prev = NULL;
+#endif
         }
     }
+    UNLOCK(&c->lock);
     return proc;
 }
 
+#if SMP
 /**
- *  Appends given process to its priority's ready queue.
+ *  Removes and returns the unpinned process nearest the tail of the
+ *  highest-priority ready queue of the given core that has one
+ *  (returns nil if no such).  The idle level is never stolen from.
  */
-static void append(Process *proc)
+static Process *take_tail(Core *c)
 {
     // INTERRUPTS MUST BE DISABLED
-    ReadyQ *queue = &readyQ[proc->pri];
+    Process *proc = NULL;
+    LOCK(&c->lock);
+    int pri;
+    for (pri = highest_ready_on(c); pri > PRI_MIN && proc == NULL; pri--) {
+        if (!is_ready(c, pri)) continue;
+        ReadyQ *queue = &c->readyQ[pri];
+
+        // find unpinned process nearest tail
+        for (proc = queue->tail; proc != NULL; proc = proc->prev) {
+            if (!proc->pinned) break;
+        }
+        if (proc == NULL) continue;
+
+        // unlink it
+        if (proc->prev != NULL) {
+            proc->prev->next = proc->next;
+        } else {
+            queue->head = proc->next;
+        }
+        if (proc->next != NULL) {
+            proc->next->prev = proc->prev;
+        } else {
+            queue->tail = proc->prev;
+        }
+        if (queue->head == NULL) {
+            show_not_ready(c, pri);  // show no ready process at level pri
+        }
+    }
+    UNLOCK(&c->lock);
+    return proc;
+}
+#endif
+
+/**
+ *  Appends given process to its priority's ready queue
+ *  on given core, which is locked.
+ */
+static void append_locked(Core *c, Process *proc)
+{
+    // INTERRUPTS MUST BE DISABLED, CORE LOCKED
+    ReadyQ *queue = &c->readyQ[proc->pri];
     if (queue->tail != NULL) {
         queue->tail->next = proc;
     }
+#if SMP
+    proc->prev = queue->tail;
+#endif
     queue->tail = proc;
     proc->next = NULL;
     if (queue->head == NULL) {
         queue->head = proc;
-        priority_mask |= mask[proc->pri];  // show ready process at level pri
+        show_ready(c, proc->pri);  // show ready process at level pri
     }
+}
+
+/**
+ *  Appends given process to its priority's ready queue
+ *  on its home core.
+ */
+static void append(Process *proc)
+{
+    // INTERRUPTS MUST BE DISABLED
+    Core *c = HOME(proc);
+    LOCK(&c->lock);
+    append_locked(c, proc);
+    UNLOCK(&c->lock);
 /****
     if (queue->head != NULL) {
         proc->next = queue->head;
@@ -185,6 +337,31 @@ static void append(Process *proc)
 ****/
 }
 
+/**
+ *  Puts given process at the head of its priority's ready queue
+ *  on its home core, so it is the next of its priority to run.
+ */
+static void push(Process *proc)
+{
+    // INTERRUPTS MUST BE DISABLED
+    Core *c = HOME(proc);
+    LOCK(&c->lock);
+    ReadyQ *queue = &c->readyQ[proc->pri];
+    proc->next = queue->head;
+#if SMP
+    proc->prev = NULL;
+    if (queue->head != NULL) {
+        queue->head->prev = proc;
+    }
+#endif
+    queue->head = proc;
+    if (queue->tail == NULL) {
+        queue->tail = proc;
+        show_ready(c, proc->pri);  // show ready process at level pri
+    }
+    UNLOCK(&c->lock);
+}
+
 /**
  *  Returns priority of currently executing process.
  */
@@ -194,17 +371,81 @@ int currentPriority()
     return current->pri;
 }
 
+/**
+ *  Makes given process the currently executing process.
+ */
+static inline void set_current(Process *proc)
+{
+    current = proc;
+    core->running = proc->pri;
+}
+
+/**
+ *  If given process is in state 'from', changes it to state 'to'
+ *  and returns true, otherwise returns false.
+ */
+static inline _Bool change_state(Process *proc, int8_t from, int8_t to)
+{
+#if SMP
+    // another core may be changing the state too
+    return CAS(&proc->state, &from, to);
+#else
+    if (proc->state != from) return false;
+    proc->state = to;
+    return true;
+#endif
+}
+
 /** 
- *  Starts a process.
- *  rtc is the function called each time the process executes
- *  local_struct is a struct containing all of the process's local variables
- *  local_size is the size of lcoal_struct in bytes
- *  pri is the priority of the new process
+ *  Returns the scheduler's counters, summed over cores.
  */
-void start(void(*rtc)(void *), void *local_struct, unsigned int local_size, int pri)
+void get_sched_stats(SchedStats *stats)
+{
+    stats->steals = stats->failed_steals = stats->handoffs = 0;
+    int c;
+    for (c = 0; c < ncores; c++) {
+        stats->steals += cores[c].steals;
+        stats->failed_steals += cores[c].failed_steals;
+        stats->handoffs += cores[c].total_handoffs;
+    }
+}
+
+/**
+ *  Sets direct-handoff policy for processes started from now on.
+ */
+void set_handoff(_Bool on)
 {
-    // Check for valid priority.
+    handoff_default = on;
+}
+
+/**
+ *  Sets direct-handoff policy for the current process.
+ */
+void set_process_handoff(_Bool on)
+{
+    current->handoff = on;
+}
+
+/** 
+ *  Sets number of cores to run processes on.
+ *  Call before starting processes.
+ */
+void set_cores(int n)
+{
+    if (n < 1 || n > MAX_CORES) error("Invalid number of cores");
+    ncores = n;
+}
+
+/** 
+ *  Starts a process with a given home core, which it leaves only
+ *  if it is unpinned and another core steals it.
+ */
+static void launch(void(*rtc)(void *), void *local_struct, 
+    unsigned int local_size, int pri, int home, _Bool pinned)
+{
+    // Check for valid priority and core.
     if (pri < 1 || pri > PRI_MAX) error("Invalid priority");
+    if (home < 0 || home >= ncores) error("Invalid core");
 
     // Compute size or process record + user's local variables.
     unsigned int total_size = proc_offset + local_size;
@@ -225,18 +466,48 @@ void start(void(*rtc)(void *), void *local_struct, unsigned int local_size, int
     proc->index = index;
     proc->pri = pri;
     proc->state = PROC_INITIAL;
+    proc->handoff = handoff_default;
     proc->alt.guards = NULL;
     proc->alt.nrGuards = 0;
+#if SMP
+    proc->core = home;
+    proc->pinned = pinned;
+#endif
 
     // put new process on its ready queue
     append(proc);
 }
 
 /** 
- *  Starts the idle process.
+ *  Starts a process on the next core in turn.
+ *  rtc is the function called each time the process executes
+ *  local_struct is a struct containing all of the process's local variables
+ *  local_size is the size of lcoal_struct in bytes
+ *  pri is the priority of the new process
+ */
+void start(void(*rtc)(void *), void *local_struct, unsigned int local_size, int pri)
+{
+    int home = next_core;
+    next_core = (home + 1) % ncores;
+    launch(rtc, local_struct, local_size, pri, home, false);
+}
+
+/** 
+ *  Starts a process pinned to a given core (it is never stolen).
+ *  home is the core the process runs on
+ *  (other parameters as for start)
+ */
+void start_on(void(*rtc)(void *), 
+    void *local_struct, unsigned int local_size, int pri, int home)
+{
+    launch(rtc, local_struct, local_size, pri, home, true);
+}
+
+/** 
+ *  Starts the idle process for a given core.
  *  rtc is the function called when the process executes
  */
-static void start_idle(void(*rtc)(void *))
+static void start_idle(void(*rtc)(void *), int home)
 {
     // Allocate memory for process record 
     int index = find_mem_index(sizeof(struct Process));    
@@ -249,21 +520,49 @@ static void start_idle(void(*rtc)(void *))
     proc->index = index;
     proc->pri = PRI_MIN;
     proc->state = PROC_INITIAL;
+    proc->handoff = false;
     proc->alt.guards = NULL;
     proc->alt.nrGuards = 0;
+#if SMP
+    proc->core = home;
+    proc->pinned = true;
+#endif
 
-    // make idle process initially the current process
-    current = proc;
+    // make idle process initially the current process on its core
+    cores[home].idle = proc;
+    cores[home].running = PRI_MIN;
 
     // put new process on the ready queue
     append(proc);
 }
 
+static void touch(Guard *guard);
+static _Bool disable_guard(Guard *g);
+static inline AltState *alt_state(Alternation *alt);
+
+/**
+ *  Withdraws the guards the current process's persistent ALT left 
+ *  enabled (before the process terminates or initializes its ALT
+ *  afresh).
+ */
+static void withdraw_alt()
+{
+    AltState *state = alt_state(&current->alt);
+    if (state != NULL && state->persistent) {
+        while (state->enabled != 0) {
+            touch(&state->guards[__builtin_ctz(state->enabled)]);
+        }
+    }
+}
+
 /**
  *  Terminates a process when (called by the terminating process).
  */
 void terminate()
 {
+    // withdraw guards a persistent ALT left enabled
+    withdraw_alt();
+
     // mark process terminated (scheduler will do the rest)
     current->state = PROC_DONE; 
 }
@@ -274,6 +573,68 @@ static inline Alternation *alternation(Process *proc)
     return &(proc->alt);
 }
 
+/** 
+ *  Returns the AltState of an event-driven ALT (NULL for a plain
+ *  ALT).  The tag and the pointer are read together, so a partner
+ *  marking the ALT sees a state the process has supplied.
+ */
+static inline AltState *alt_state(Alternation *alt)
+{
+    uintptr_t state = LOAD(&alt->state);
+    return (state & ALT_STATE) ? (AltState *)(state - ALT_STATE) : NULL;
+}
+
+/** Returns the guards of ALT */
+static inline Guard *alt_guards(Alternation *alt)
+{
+    AltState *state = alt_state(alt);
+    return (state != NULL ? state->guards : alt->guards);
+}
+
+/** 
+ *  Marks given branch of process's ALT ready.  (Only an event-driven
+ *  ALT has marks; they are cleared when it is enabled, or for a
+ *  persistent ALT, when the branch is disabled.)
+ */
+static inline void mark_ready(Process *proc, int index)
+{
+    AltState *state = alt_state(&proc->alt);
+    if (state != NULL && state->event && index < ALT_EVENT_MAX) {
+        OR(&state->ready, 1U << index);
+    }
+}
+
+/** 
+ *  Notes that given guard of current process's persistent ALT is
+ *  about to change, withdrawing it from its channel (or timer queue
+ *  etc.) if it is enabled there, so that it will be enabled afresh.
+ */
+static void touch(Guard *guard)
+{
+    Process *proc = current;
+    if (proc == NULL) {
+        return;
+    }
+    Alternation *alt = alternation(proc);
+    AltState *state = alt_state(alt);
+    if (state == NULL || !state->persistent) {
+        return;
+    }
+    unsigned int i = guard - state->guards;
+    if (i >= alt->nrGuards) {
+        return;                          // not one of ALT's guards
+    }
+    uint32_t bit = 1U << i;
+    if (state->enabled & bit) {
+        DISABLE;
+        disable_guard(guard);
+        ENABLE;
+        state->enabled &= ~bit;
+    }
+    AND(&state->ready, ~bit);
+    state->dirty |= bit;
+}
+
 /** Returns selected branch of ALT. */
 int selected() 
 {
@@ -287,6 +648,110 @@ inline void init_channel(Channel *chan)
     chan->src = NULL;
 }
 
+/** Initializes small channel */
+inline void init_small_channel(SmallChannel *chan)
+{
+    chan->waiting = NULL;
+    chan->src = NULL;
+}
+
+/** Returns input end of small channel. */
+inline ChanIn *in_small(SmallChannel *chan)
+{
+    return (ChanIn *)chan;
+}
+
+/** Returns output end of small channel. */
+inline ChanOut *out_small(SmallChannel *chan)
+{
+    return (ChanOut *)chan;
+}
+
+/** Initializes buffered channel */
+void init_buffered_channel(BufferedChannel *chan, 
+    void *buffer, unsigned int size, unsigned int capacity)
+{
+    if (capacity == 0) error("Buffered channel capacity must be nonzero");
+    chan->reader = NULL;
+    chan->writer = NULL;
+    chan->buffer = buffer;
+    chan->size = size;
+    chan->capacity = capacity;
+    chan->first = 0;
+    chan->count = 0;
+    INIT_LOCK(&chan->lock);
+}
+
+/** Initializes channel array */
+void init_channel_array(ChannelArray *array, 
+    Channel *channels, uint32_t *bits, int size)
+{
+    if (size <= 0) error("Channel array size must be nonzero");
+    int i;
+    for (i = 0; i < size; i++) {
+        init_channel(&channels[i]);
+    }
+    array->channels = channels;
+    array->ready = bits;
+    array->size = size;
+    array->nwords = (size + 31) / 32;
+    for (i = 0; i < CHANNEL_ARRAY_WORDS(size); i++) {
+        bits[i] = 0;
+    }
+    array->nready = 0;
+    array->selected = size - 1;
+    array->reader = NULL;
+    INIT_LOCK(&array->lock);
+}
+
+/** Initializes shared channel */
+void init_shared_channel(SharedChannel *chan)
+{
+    chan->reader = NULL;
+    chan->first = NULL;
+    chan->last = NULL;
+    INIT_LOCK(&chan->lock);
+}
+
+/** Initializes broadcast channel */
+void init_broadcast_channel(BroadcastChannel *chan, int nreaders)
+{
+    if (nreaders < 1 || nreaders > BROADCAST_MAX) {
+        error("Invalid number of broadcast channel readers");
+    }
+    chan->writer = NULL;
+    chan->nreaders = nreaders;
+    chan->pending = 0;
+    int r;
+    for (r = 0; r < nreaders; r++) {
+        chan->readers[r] = NULL;
+    }
+    INIT_LOCK(&chan->lock);
+}
+
+/** Initializes batch channel */
+void init_batch_channel(BatchChannel *chan, unsigned int size)
+{
+    if (size == 0) error("Batch channel item size must be nonzero");
+    chan->waiting = NULL;
+    chan->src = NULL;
+    chan->size = size;
+    chan->count = 0;
+    chan->taken = 0;
+}
+
+/** Returns # of items last passed on batch channel. */
+unsigned int batch_count(BatchChannel *chan)
+{
+    return LOAD(&chan->taken);
+}
+
+/** Returns channel of array last input. */
+int selected_channel(ChannelArray *array)
+{
+    return array->selected;
+}
+
 /** Returns input end of channel. */
 inline ChanIn *in(Channel *chan)
 {
@@ -303,25 +768,108 @@ inline ChanOut *out(Channel *chan)
 void init_alt(Guard *guards, int size) 
 {
     Alternation *alt = alternation(current);
-    alt->guards = guards;
+    withdraw_alt();
+    STORE(&alt->guards, guards);
     alt->nrGuards = size;
     alt->alt_pri = false;
     alt->index = size-1;
 }
 
+/** Initializes alternation with a single guard */
+inline void init_single(Guard *guard)
+{
+    init_alt(guard, 1);
+}
+
 /** Initializes alternation for priority selection */
 void init_alt_pri(Guard *guards, int size) 
 {
     Alternation *alt = alternation(current);
-    alt->guards = guards;
+    withdraw_alt();
+    STORE(&alt->guards, guards);
     alt->nrGuards = size;
     alt->alt_pri = true;
 }
 
+/** Keeps alternation's state in given AltState */
+static void attach_state(Alternation *alt, AltState *state, _Bool event)
+{
+    state->guards = alt->guards;
+    state->enabled = 0;
+    state->ready = 0;
+    state->dirty = 0;
+    state->claim = NULL;
+    state->event = event;
+    state->persistent = false;
+    state->offering = false;
+    STORE(&alt->state, (uintptr_t)state | ALT_STATE);
+}
+
+/** Makes alternation event-driven, keeping its state in given AltState */
+static void make_event(Alternation *alt, AltState *state)
+{
+    if (alt->nrGuards > ALT_EVENT_MAX) {
+        error("Too many guards for event-driven ALT");
+    }
+    attach_state(alt, state, true);
+}
+
+/** Initializes alternation for fair event-driven selection */
+void init_alt_event(Guard *guards, int size, AltState *state) 
+{
+    init_alt(guards, size);
+    make_event(alternation(current), state);
+}
+
+/** Initializes alternation for event-driven priority selection */
+void init_alt_pri_event(Guard *guards, int size, AltState *state) 
+{
+    init_alt_pri(guards, size);
+    make_event(alternation(current), state);
+}
+
+/** Makes alternation persistent, with all its guards to be enabled */
+static void make_persistent(Alternation *alt, AltState *state)
+{
+    make_event(alt, state);
+    state->persistent = true;
+    state->dirty = (alt->nrGuards == 0 ? 0 : 
+        ~0U >> (ALT_EVENT_MAX - alt->nrGuards));
+}
+
+/** Initializes persistent alternation for fair selection */
+void init_alt_persistent(Guard *guards, int size, AltState *state) 
+{
+    init_alt(guards, size);
+    make_persistent(alternation(current), state);
+}
+
+/** Initializes persistent alternation for priority selection */
+void init_alt_pri_persistent(Guard *guards, int size, AltState *state) 
+{
+    init_alt_pri(guards, size);
+    make_persistent(alternation(current), state);
+}
+
+/** Initializes symmetric alternation for fair selection */
+void init_alt_symmetric(Guard *guards, int size, AltState *state) 
+{
+    init_alt(guards, size);
+    attach_state(alternation(current), state, false);
+}
+
+/** Initializes symmetric alternation for priority selection */
+void init_alt_pri_symmetric(Guard *guards, int size, AltState *state) 
+{
+    init_alt_pri(guards, size);
+    attach_state(alternation(current), state, false);
+}
+
 /** Initializes channel input guard */
 inline void init_chanin_guard(
     Guard *guard, ChanIn *chan, void *dest, unsigned int len)
 {
+    touch(guard);
     guard->type = GUARD_CHANIN;    
     guard->chanin.channel = (Channel *)chan;
     guard->chanin.dest = dest;
@@ -332,6 +880,7 @@ inline void init_chanin_guard(
 inline void init_chanin_guard_for_interrupt(
                       Guard *guard, ChanIn *chan, void *dest)
 {
+    touch(guard);
     guard->type = GUARD_INTERRUPT;
     guard->interrupt.channel = (InterruptChannel *)chan;
     guard->interrupt.dest = dest;
@@ -340,56 +889,239 @@ inline void init_chanin_guard_for_interrupt(
 /** Initializes channel output guard */
 inline void init_chanout_guard(Guard *guard, ChanOut *chan, void *src)
 {
+    touch(guard);
     guard->type = GUARD_CHANOUT;    
     guard->chanout.channel = (Channel *)chan;
     guard->chanout.src = src;
 }
 
-/** Initializes skip guard */
-inline void init_skip_guard(Guard *guard)
+/** Initializes buffered channel input guard */
+inline void init_bufin_guard(Guard *guard, BufferedChannel *chan, void *dest)
 {
-    guard->type = GUARD_SKIP;
+    touch(guard);
+    guard->type = GUARD_BUFIN;
+    guard->buffered.channel = chan;
+    guard->buffered.addr = dest;
 }
 
-/** Initializes timeout guard */
-inline void init_timeout_guard(Guard *guard, Timeout *timeout, Time time)
+/** Initializes buffered channel output guard */
+inline void init_bufout_guard(Guard *guard, BufferedChannel *chan, void *src)
 {
-    guard->type = GUARD_TIMEOUT;
-    guard->timeout = timeout;
-    timeout->time = time;
-    timeout->proc = current;
+    touch(guard);
+    guard->type = GUARD_BUFOUT;
+    guard->buffered.channel = chan;
+    guard->buffered.addr = src;
 }
 
-/** Activates a guard */
-inline void activate(Guard *guard)
+/** Initializes replicated input guard for channel array */
+inline void init_arrayin_guard(
+    Guard *guard, ChannelArray *array, void *dest, unsigned int len)
 {
-   guard->active = true;
+    touch(guard);
+    guard->type = GUARD_ARRAYIN;
+    guard->replicated.array = array;
+    guard->replicated.addr = dest;
+    guard->replicated.n = len;
 }
 
-/** Decctivates a guard */
-inline void deactivate(Guard *guard) 
+/** Initializes output guard for channel of channel array */
+inline void init_arrayout_guard(
+    Guard *guard, ChannelArray *array, int i, void *src)
 {
-    guard->active = false;
+    touch(guard);
+    if (i < 0 || i >= array->size) error("Invalid channel of array");
+    guard->type = GUARD_ARRAYOUT;
+    guard->replicated.array = array;
+    guard->replicated.addr = src;
+    guard->replicated.n = i;
 }
 
-/** Returns true if guard is active */
-inline _Bool is_active(Guard *guard)
+/** Initializes shared channel input guard */
+inline void init_sharedin_guard(
+    Guard *guard, SharedChannel *chan, void *dest, unsigned int len)
 {
-    return guard->active;
+    touch(guard);
+    guard->type = GUARD_SHAREDIN;
+    guard->shared.channel = chan;
+    guard->shared.addr = dest;
+    guard->shared.len = len;
 }
 
-/** Makes a guard active or inactive */
-inline void set_active(Guard *guard, _Bool active)
+/** Initializes shared channel output guard */
+inline void init_sharedout_guard(Guard *guard, SharedChannel *chan, void *src)
 {
-    guard->active = active;
+    touch(guard);
+    guard->type = GUARD_SHAREDOUT;
+    guard->shared.channel = chan;
+    guard->shared.addr = src;
 }
 
-/** Connects user interrupt to channel */
-void connect_interrupt_to_channel(ChanIn *chan, int intrno)
+/** Initializes broadcast channel input guard */
+inline void init_bcastin_guard(Guard *guard, 
+    BroadcastChannel *chan, int reader, void *dest, unsigned int len)
 {
-    // develop user interrupt number from interrupt number
-    int intrsrc = intrno + INTR_USER0;
-
+    touch(guard);
+    if (reader < 0 || reader >= chan->nreaders) {
+        error("Invalid broadcast channel reader");
+    }
+    if (len > UINT16_MAX) error("Broadcast message too long");
+    guard->type = GUARD_BCASTIN;
+    guard->broadcast.channel = chan;
+    guard->broadcast.addr = dest;
+    guard->broadcast.len = len;
+    guard->broadcast.reader = reader;
+}
+
+/** Initializes broadcast channel output guard */
+inline void init_bcastout_guard(
+    Guard *guard, BroadcastChannel *chan, void *src)
+{
+    touch(guard);
+    guard->type = GUARD_BCASTOUT;
+    guard->broadcast.channel = chan;
+    guard->broadcast.addr = src;
+}
+
+/** Initializes batch channel input guard */
+inline void init_batchin_guard(
+    Guard *guard, BatchChannel *chan, void *dest, unsigned int max)
+{
+    touch(guard);
+    if (max == 0) error("Batch must have at least one item");
+    guard->type = GUARD_BATCHIN;
+    guard->batch.channel = chan;
+    guard->batch.addr = dest;
+    guard->batch.n = max;
+}
+
+/** Initializes batch channel output guard */
+inline void init_batchout_guard(
+    Guard *guard, BatchChannel *chan, void *src, unsigned int count)
+{
+    touch(guard);
+    if (count == 0) error("Batch must have at least one item");
+    guard->type = GUARD_BATCHOUT;
+    guard->batch.channel = chan;
+    guard->batch.addr = src;
+    guard->batch.n = count;
+}
+
+/** Initializes small channel input guard */
+inline void init_small_chanin_guard(
+    Guard *guard, ChanIn *chan, void *dest, unsigned int len)
+{
+    touch(guard);
+    if (len > SMALL_MSG_MAX) error("Small channel message too long");
+    guard->type = GUARD_SMALLIN;
+    guard->chanin.channel = (Channel *)chan;
+    guard->chanin.dest = dest;
+    guard->chanin.len = len;
+}
+
+/** Initializes small channel output guard */
+inline void init_small_chanout_guard(
+    Guard *guard, ChanOut *chan, void *src, unsigned int len)
+{
+    touch(guard);
+    if (len > SMALL_MSG_MAX) error("Small channel message too long");
+    guard->type = GUARD_SMALLOUT;
+    guard->chanout.channel = (Channel *)chan;
+    guard->chanout.src = src;
+    guard->chanout.len = len;
+}
+
+/** Initializes message input guard */
+inline void init_msgin_guard(Guard *guard, ChanIn *chan, Message **dest)
+{
+    touch(guard);
+    guard->type = GUARD_MSGIN;
+    guard->chanin.channel = (Channel *)chan;
+    guard->chanin.dest = dest;
+    guard->chanin.len = sizeof(Message *);
+}
+
+/** Initializes message output guard */
+inline void init_msgout_guard(Guard *guard, ChanOut *chan, Message **src)
+{
+    touch(guard);
+    init_chanout_guard(guard, chan, src);
+}
+
+/** Initializes skip guard */
+inline void init_skip_guard(Guard *guard)
+{
+    touch(guard);
+    guard->type = GUARD_SKIP;
+}
+
+/** Initializes timeout guard */
+inline void init_timeout_guard(Guard *guard, Timeout *timeout, Time time)
+{
+    touch(guard);
+    guard->type = GUARD_TIMEOUT;
+    guard->timeout = timeout;
+    timeout->time = time;
+    timeout->period = 0;
+    timeout->overruns = 0;
+    timeout->proc = current;
+    timeout->link = NULL;
+}
+
+/** Initializes periodic timeout guard */
+inline void init_periodic_guard(
+    Guard *guard, Timeout *timeout, Time start, Time period)
+{
+    if (period == 0) error("Periodic timeout needs a period");
+    init_timeout_guard(guard, timeout, start);
+    timeout->period = period;
+}
+
+/** Returns # of periods periodic timeout missed before its branch
+ *  was last selected */
+unsigned int overruns(Timeout *timeout)
+{
+    return timeout->overruns;
+}
+
+/** Activates a guard */
+inline void activate(Guard *guard)
+{
+    if (!guard->active) {
+        guard->active = true;
+        touch(guard);
+    }
+}
+
+/** Decctivates a guard */
+inline void deactivate(Guard *guard) 
+{
+    if (guard->active) {
+        guard->active = false;
+        touch(guard);
+    }
+}
+
+/** Returns true if guard is active */
+inline _Bool is_active(Guard *guard)
+{
+    return guard->active;
+}
+
+/** Makes a guard active or inactive */
+inline void set_active(Guard *guard, _Bool active)
+{
+    if (guard->active != active) {
+        guard->active = active;
+        touch(guard);
+    }
+}
+
+/** Connects user interrupt to channel */
+void connect_interrupt_to_channel(ChanIn *chan, int intrno)
+{
+    // develop user interrupt number from interrupt number
+    int intrsrc = intrno + INTR_USER0;
+
     // check for valid user interrupt numbber
     if (!(INTR_USER0 <= intrsrc && intrsrc < NINTR_SOURCES)) error(
         "connect_interrupt_to_channel: Invalid user interrupt source number");
@@ -414,23 +1146,47 @@ void disconnect_interrupt_from_channel(int intrno)
     channel_for_interrupt[intrsrc-INTR_USER0] = NULL;    // unmap intr 
 }
 
+/**
+ *  Channel protocol.
+ *  The channel word (waiting) is NULL when the channel is idle, and 
+ *  otherwise holds the inputter or outputter waiting in it.  Every
+ *  change to it is a single atomic operation, so processes on different
+ *  cores rendezvous without a lock:
+ *    inputter enables:   store branch index, then 
+ *                        CAS NULL -> inputter (else outputter waiting)
+ *    outputter enables:  store src, then EXCH outputter into word,
+ *                        marking and readying any inputter it displaces
+ *    inputter disables:  CAS inputter -> NULL (else outputter arrived)
+ *    inputter transfers: copy from src, then store NULL
+ *  An outputter in a symmetric ALT offering outputs (output guards 
+ *  enabled along with others) is not committed by its offer.  An inputter selecting its
+ *  channel must first claim it (CAS its claim NULL -> channel), and
+ *  an inputter finding the offer of one already committed elsewhere
+ *  takes the offer's place in the channel word and waits.
+ */
+
 /**
  *  Enables a channel for input.
  */
-static _Bool enable_channel_input(Channel *chan, Process **partner)
+static _Bool enable_channel_input(Channel *chan, int index, Process **partner)
 {
     // INTERRUPTS DISABLED
-    if (chan->waiting != NULL) {
-        if (chan->waiting == current) {
+    STORE(&chan->index, index);         // branch to mark when readied
+    Process *waiting = NULL;
+    while (!CAS(&chan->waiting, &waiting, current)) {
+        AltState *state;
+        if (waiting == current) {
             return false;               // just us, not ready
-        } else {
-            *partner = chan->waiting;   // return waiting process
+        } else if ((state = alt_state(&waiting->alt)) == NULL ||
+                   !LOAD(&state->offering) || 
+                   LOAD(&state->claim) == NULL) {
+            *partner = waiting;         // return waiting outputter
             return true;                // ready
         }
-    } else {                          
-        chan->waiting = current;        // wait in this channel
-        return false;                   // not ready
+        // outputter committed elsewhere: take its place (or if 
+        // it withdrew meanwhile, try again)
     }
+    return false;                       // now waiting in channel, not ready
 }
 
 /**
@@ -439,17 +1195,16 @@ static _Bool enable_channel_input(Channel *chan, Process **partner)
 static _Bool disable_channel_input(Channel *chan, Process **partner)
 {
     // INTERRUPTS DISABLED
-    if (chan->waiting != NULL) {
-        if (chan->waiting != current) {
-            *partner = chan->waiting;    // return waiting partner
-            return true;                 // ready
-        } else {
-            chan->waiting = NULL;        // just us, disable channel
-            return false;                // not ready
-        }
-    } else {                             // channel not enabled
-        return false;                    // not ready
-    } 
+    Process *waiting = LOAD(&chan->waiting);
+    if (waiting == NULL) {
+        return false;                    // channel not enabled, not ready
+    } else if (waiting == current &&
+               CAS(&chan->waiting, &waiting, NULL)) {
+        return false;                    // just us, disabled; not ready
+    } else {
+        *partner = waiting;              // return waiting partner
+        return true;                     // ready
+    }
 }
 
 /**
@@ -458,246 +1213,1339 @@ static _Bool disable_channel_input(Channel *chan, Process **partner)
 static _Bool enable_channel_output(Channel *chan, void *src, Process **partner)
 {
     // INTERRUPTS DISABLED
-    //ASSERT(chan->waiting != NULL);
-    *partner = chan->waiting;        // return partner (inputter)
-    chan->waiting = current;         // wait in this channel
-    chan->src = src;                 // leave source addr in channel
-    return false;                    // not quite ready yet
+    STORE(&chan->src, src);              // leave source addr in channel
+    *partner = EXCH(&chan->waiting, current);  // wait in channel, return
+                                               // partner (inputter) if any
+    if (*partner != NULL) {
+        mark_ready(*partner, LOAD(&chan->index));
+    }
+    return false;                        // not quite ready yet
+}
+
+/**
+ *  Copies a small message (no longer than SMALL_MSG_MAX) with
+ *  inline moves rather than a call to Memcpy.
+ */
+static inline void copy_small(void *dest, const void *src, unsigned int len)
+{
+    switch (len) {
+    case 4:  __builtin_memcpy(dest, src, 4);  break;
+    case 8:  __builtin_memcpy(dest, src, 8);  break;
+    case 16: __builtin_memcpy(dest, src, 16); break;
+    default: {
+        char *d = (char *)dest;
+        const char *s = (const char *)src;
+        while (len-- > 0) *d++ = *s++;
+        }
+    }
+}
+
+/**
+ *  Enables a small channel for output.  The message is copied
+ *  into the channel before the outputter is seen waiting there.
+ */
+static _Bool enable_small_output(
+    SmallChannel *chan, void *src, unsigned int len, Process **partner)
+{
+    // INTERRUPTS DISABLED
+    copy_small(chan->data, src, len);
+    return enable_channel_output((Channel *)chan, chan->data, partner);
+}
+
+/**
+ *  Enables a batch channel for output.  The # of items offered is
+ *  left in the channel before the writer is seen waiting there.
+ */
+static _Bool enable_batch_output(
+    BatchChannel *chan, void *src, unsigned int count, Process **partner)
+{
+    // INTERRUPTS DISABLED
+    STORE(&chan->count, count);
+    return enable_channel_output((Channel *)chan, src, partner);
+}
+
+/**
+ *  Enables an interrupt channel to receive an interrupt.
+ */
+static _Bool enable_interrupt_channel(InterruptChannel *chan, int index)
+{
+    // INTERRUPTS DISABLED
+    STORE(&chan->index, index);          // branch to mark when readied
+    STORE(&chan->waiting, current);      // wait in channel
+    FENCE;                               // (pairs with handler's fence)
+    return (LOAD(&chan->count) > 0);     // ready if interrupt has occurred
+}
+
+/**
+ *  Disables an interrupt channel.
+ */
+static _Bool disable_interrupt_channel(InterruptChannel *chan)
+{
+    // INTERRUPTS DISABLED
+    STORE(&chan->waiting, NULL);         // we're not waiting now
+    return (LOAD(&chan->count) > 0);     // ready if interrupt has occurred
+}
+
+/**
+ *  Buffered channel protocol.
+ *  An input guard is ready while the channel holds an item and an
+ *  output guard while it has room, so neither waits for a partner
+ *  to be scheduled.  A reader finding the channel empty (or a writer 
+ *  finding it full) waits in it, and is readied by the writer that 
+ *  puts an item in (or the reader that takes one out).
+ */
+
+/**
+ *  Enables a buffered channel for input.
+ */
+static _Bool enable_buffered_input(BufferedChannel *chan, int index)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    _Bool ready = (chan->count > 0);
+    if (!ready) {
+        chan->reader = current;          // wait for an item
+        chan->reader_index = index;
+    }
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Disables a buffered channel for input.
+ */
+static _Bool disable_buffered_input(BufferedChannel *chan)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    if (chan->reader == current) {
+        chan->reader = NULL;             // we're not waiting now
+    }
+    _Bool ready = (chan->count > 0);
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Enables a buffered channel for output.
+ */
+static _Bool enable_buffered_output(BufferedChannel *chan, int index)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    _Bool ready = (chan->count < chan->capacity);
+    if (!ready) {
+        chan->writer = current;          // wait for room
+        chan->writer_index = index;
+    }
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Disables a buffered channel for output.
+ */
+static _Bool disable_buffered_output(BufferedChannel *chan)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    if (chan->writer == current) {
+        chan->writer = NULL;             // we're not waiting now
+    }
+    _Bool ready = (chan->count < chan->capacity);
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Takes oldest item from buffered channel, returning the
+ *  writer waiting for room if any.
+ */
+static Process *take_item(BufferedChannel *chan, void *dest)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    Memcpy(dest, chan->buffer + chan->first * chan->size, chan->size);
+    if (++chan->first == chan->capacity) {
+        chan->first = 0;
+    }
+    chan->count--;
+    Process *writer = chan->writer;
+    if (writer != NULL) {
+        mark_ready(writer, chan->writer_index);
+        chan->writer = NULL;
+    }
+    UNLOCK(&chan->lock);
+    return writer;
+}
+
+/**
+ *  Puts item in buffered channel, returning the reader
+ *  waiting for an item if any.
+ */
+static Process *put_item(BufferedChannel *chan, void *src)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    unsigned int last = chan->first + chan->count;
+    if (last >= chan->capacity) {
+        last -= chan->capacity;
+    }
+    Memcpy(chan->buffer + last * chan->size, src, chan->size);
+    chan->count++;
+    Process *reader = chan->reader;
+    if (reader != NULL) {
+        mark_ready(reader, chan->reader_index);
+        chan->reader = NULL;
+    }
+    UNLOCK(&chan->lock);
+    return reader;
+}
+
+/**
+ *  Channel array protocol.
+ *  An outputter on a channel of the array waits in the channel as
+ *  usual, then sets the channel's bit in the array's readiness bits
+ *  (and the bit for that word in the summary bits that follow them),
+ *  readying the reader if it waits in the array.  The reader never 
+ *  waits in the channels themselves, so enabling and disabling the 
+ *  replicated guard cost the same for any number of channels, and
+ *  the next channel is found by bit scans over the summary and one
+ *  word of channel bits.
+ */
+
+/** Notes that an outputter waits in given channel of array */
+static inline void set_array_bit(ChannelArray *array, int i)
+{
+    // ARRAY LOCKED
+    int w = i >> 5;
+    array->ready[w] |= (1U << (i & 31));
+    array->ready[array->nwords + (w >> 5)] |= (1U << (w & 31));
+    array->nready++;
+}
+
+/** Notes that given channel of array was input */
+static inline void clear_array_bit(ChannelArray *array, int i)
+{
+    // ARRAY LOCKED
+    int w = i >> 5;
+    array->ready[w] &= ~(1U << (i & 31));
+    if (array->ready[w] == 0) {
+        array->ready[array->nwords + (w >> 5)] &= ~(1U << (w & 31));
+    }
+    array->nready--;
+}
+
+/** 
+ *  Returns first channel of array from i on with an outputter 
+ *  waiting, or -1 if none.
+ */
+static int next_array_bit(ChannelArray *array, int i)
+{
+    // ARRAY LOCKED
+    if (i >= array->size) return -1;
+
+    // look in i's own word
+    int w = i >> 5;
+    uint32_t bits = array->ready[w] & (~0U << (i & 31));
+    if (bits != 0) {
+        return (w << 5) + __builtin_ctz(bits);
+    }
+
+    // find next nonzero word from the summary bits
+    if (++w >= array->nwords) return -1;
+    uint32_t *summary = &array->ready[array->nwords];
+    int nsummary = (array->nwords + 31) >> 5;
+    int s = w >> 5;
+    bits = summary[s] & (~0U << (w & 31));
+    while (bits == 0) {
+        if (++s == nsummary) return -1;
+        bits = summary[s];
+    }
+    w = (s << 5) + __builtin_ctz(bits);
+    return (w << 5) + __builtin_ctz(array->ready[w]);
+}
+
+/**
+ *  Enables channel array for input.
+ */
+static _Bool enable_array_input(ChannelArray *array, int index)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&array->lock);
+    _Bool ready = (array->nready > 0);
+    if (!ready) {
+        array->reader = current;         // wait for an outputter
+        array->reader_index = index;
+    }
+    UNLOCK(&array->lock);
+    return ready;
+}
+
+/**
+ *  Disables channel array for input.
+ */
+static _Bool disable_array_input(ChannelArray *array)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&array->lock);
+    if (array->reader == current) {
+        array->reader = NULL;            // we're not waiting now
+    }
+    _Bool ready = (array->nready > 0);
+    UNLOCK(&array->lock);
+    return ready;
+}
+
+/**
+ *  Enables given channel of array for output.
+ */
+static _Bool enable_array_output(
+    ChannelArray *array, int i, void *src, Process **partner)
+{
+    // INTERRUPTS DISABLED
+    Channel *chan = &array->channels[i];
+    STORE(&chan->src, src);              // make data available
+    STORE(&chan->waiting, current);      // wait in channel
+    LOCK(&array->lock);
+    set_array_bit(array, i);
+    *partner = array->reader;            // return reader if waiting
+    if (*partner != NULL) {
+        mark_ready(*partner, array->reader_index);
+        array->reader = NULL;
+    }
+    UNLOCK(&array->lock);
+    return false;
+}
+
+/**
+ *  Selects next channel of array with an outputter waiting, 
+ *  rotating past the one last selected.
+ */
+static Channel *select_array_channel(ChannelArray *array)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&array->lock);
+    int i = next_array_bit(array, array->selected + 1);
+    if (i < 0) {
+        i = next_array_bit(array, 0);
+    }
+    clear_array_bit(array, i);
+    array->selected = i;
+    UNLOCK(&array->lock);
+    return &array->channels[i];
+}
+
+/**
+ *  Shared channel protocol.
+ *  A writer enabling the channel joins the tail of its queue of 
+ *  writers, linked through their process records (a writer waiting
+ *  there is on no ready queue), and readies the reader if it waits
+ *  in the channel.  The reader is ready while the queue is not empty,
+ *  and inputs from the writer at its head.  The writer's output guard 
+ *  is the only one active, and is left as its ALT's current branch, 
+ *  so the reader finds the data to input through it.
+ */
+
+/**
+ *  Enables a shared channel for input.
+ */
+static _Bool enable_shared_input(SharedChannel *chan, int index)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    _Bool ready = (chan->first != NULL);
+    if (!ready) {
+        chan->reader = current;          // wait for a writer
+        chan->reader_index = index;
+    }
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Disables a shared channel for input.
+ */
+static _Bool disable_shared_input(SharedChannel *chan)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    if (chan->reader == current) {
+        chan->reader = NULL;             // we're not waiting now
+    }
+    _Bool ready = (chan->first != NULL);
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Enables a shared channel for output, given branch of the 
+ *  current process's ALT.
+ */
+static _Bool enable_shared_output(
+    SharedChannel *chan, int index, Process **partner)
+{
+    // INTERRUPTS DISABLED
+    alternation(current)->index = index; // where reader finds the data
+    current->next = NULL;
+    LOCK(&chan->lock);
+    if (chan->last == NULL) {            // join queue of writers
+        chan->first = current;
+    } else {
+        chan->last->next = current;
+    }
+    chan->last = current;
+    *partner = chan->reader;             // return reader if waiting
+    if (*partner != NULL) {
+        mark_ready(*partner, chan->reader_index);
+        chan->reader = NULL;
+    }
+    UNLOCK(&chan->lock);
+    return false;
+}
+
+/**
+ *  Inputs from the writer at the head of a shared channel's 
+ *  queue, returning the writer.
+ */
+static Process *take_writer(SharedChannel *chan, void *dest, unsigned int len)
+{
+    // INTERRUPTS ENABLED
+    DISABLE;
+    LOCK(&chan->lock);
+    Process *writer = chan->first;
+    chan->first = writer->next;
+    if (chan->first == NULL) {
+        chan->last = NULL;
+    }
+    UNLOCK(&chan->lock);
+    ENABLE;
+    Alternation *alt = alternation(writer);
+    Memcpy(dest, alt_guards(alt)[alt->index].shared.addr, len); // xfr data
+    return writer;
+}
+
+/**
+ *  Broadcast channel protocol.
+ *  The writer leaves its data in the channel, sets every reader
+ *  pending, and readies the readers waiting there.  A reader is ready 
+ *  while it is pending; it copies the data and clears its pending 
+ *  bit, and the reader that clears the last one readies the writer.
+ */
+
+/**
+ *  Enables a broadcast channel for input by given reader.
+ */
+static _Bool enable_broadcast_input(
+    BroadcastChannel *chan, int reader, int index)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    _Bool ready = (chan->pending & (1U << reader)) != 0;
+    if (!ready) {
+        chan->readers[reader] = current; // wait for data
+        chan->reader_index[reader] = index;
+    }
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Disables a broadcast channel for input by given reader.
+ */
+static _Bool disable_broadcast_input(BroadcastChannel *chan, int reader)
+{
+    // INTERRUPTS DISABLED
+    LOCK(&chan->lock);
+    if (chan->readers[reader] == current) {
+        chan->readers[reader] = NULL;    // we're not waiting now
+    }
+    _Bool ready = (chan->pending & (1U << reader)) != 0;
+    UNLOCK(&chan->lock);
+    return ready;
+}
+
+/**
+ *  Enables a broadcast channel for output, readying the
+ *  readers waiting for the data.
+ */
+static _Bool enable_broadcast_output(BroadcastChannel *chan, void *src)
+{
+    // INTERRUPTS DISABLED
+    Process *waiting[BROADCAST_MAX];
+    int n = 0;
+    LOCK(&chan->lock);
+    chan->writer = current;              // wait for all readers
+    chan->src = src;
+    chan->pending = ~0U >> (32 - chan->nreaders);
+    int r;
+    for (r = 0; r < chan->nreaders; r++) {
+        Process *reader = chan->readers[r];
+        if (reader != NULL) {
+            mark_ready(reader, chan->reader_index[r]);
+            chan->readers[r] = NULL;
+            waiting[n++] = reader;
+        }
+    }
+    UNLOCK(&chan->lock);
+    while (n > 0) {
+        readyProcessIfNecessary(waiting[--n]);
+    }
+    return false;
+}
+
+/**
+ *  Inputs broadcast data for given reader, returning the writer
+ *  if the reader was the last to take it.
+ */
+static Process *take_broadcast(
+    BroadcastChannel *chan, int reader, void *dest, unsigned int len)
+{
+    // INTERRUPTS ENABLED
+    Memcpy(dest, LOAD(&chan->src), len);     // xfr data
+    DISABLE;
+    LOCK(&chan->lock);
+    chan->pending &= ~(1U << reader);
+    Process *writer = NULL;
+    if (chan->pending == 0) {
+        writer = chan->writer;
+        chan->writer = NULL;
+    }
+    UNLOCK(&chan->lock);
+    ENABLE;
+    return writer;
+}
+
+/** Adds 1 modulo given modulus */
+static inline int plus1_mod(int i, int m) { 
+    // assume 0 <= i < m
+    return (i + 1 == m ? 0 : i + 1); 
+}
+
+/** Subtracts 1 modulo given modulus */
+static inline int minus1_mod(int i, int m) {
+    // assume 0 <= i < m
+    return (i == 0 ? m - 1 : i - 1);
+}
+
+/** Returns true if guard is a (channel) output guard */
+static inline _Bool is_output_guard(Guard *g)
+{
+    return g->type == GUARD_CHANOUT || g->type == GUARD_SMALLOUT ||
+        g->type == GUARD_ARRAYOUT || g->type == GUARD_SHAREDOUT ||
+        g->type == GUARD_BCASTOUT || g->type == GUARD_BATCHOUT;
+}
+
+/**
+ *  Enables given guard, the given branch of the current process's
+ *  ALT, returning true if it is ready.
+ */
+static _Bool enable_guard(Guard *g, int i, Process **partner)
+{
+    // INTERRUPTS DISABLED
+    switch(g->type) {
+
+    case GUARD_CHANIN:
+    case GUARD_MSGIN:
+    case GUARD_SMALLIN:
+        // enable channel input
+        return enable_channel_input(g->chanin.channel, i, partner);
+
+    case GUARD_CHANOUT:
+        // enable channel output
+        return enable_channel_output(
+            g->chanout.channel, g->chanout.src, partner);
+
+    case GUARD_SMALLOUT:
+        // enable small channel output
+        return enable_small_output((SmallChannel *)g->chanout.channel,
+            g->chanout.src, g->chanout.len, partner);
+
+    case GUARD_SKIP:
+        // skip guards are always ready
+        return true;
+
+    case GUARD_TIMEOUT:
+        // enable timeout
+        g->timeout->index = i;
+        return enable_timeout(g->timeout); 
+
+    case GUARD_INTERRUPT:
+        // enable interrupt channel
+        return enable_interrupt_channel(g->interrupt.channel, i);
+
+    case GUARD_BUFIN:
+        // enable buffered channel input
+        return enable_buffered_input(g->buffered.channel, i);
+
+    case GUARD_BUFOUT:
+        // enable buffered channel output
+        return enable_buffered_output(g->buffered.channel, i);
+
+    case GUARD_ARRAYIN:
+        // enable channel array input
+        return enable_array_input(g->replicated.array, i);
+
+    case GUARD_SHAREDIN:
+        // enable shared channel input
+        return enable_shared_input(g->shared.channel, i);
+
+    case GUARD_SHAREDOUT:
+        // enable shared channel output
+        return enable_shared_output(g->shared.channel, i, partner);
+
+    case GUARD_BCASTIN:
+        // enable broadcast channel input
+        return enable_broadcast_input(
+            g->broadcast.channel, g->broadcast.reader, i);
+
+    case GUARD_BCASTOUT:
+        // enable broadcast channel output
+        return enable_broadcast_output(
+            g->broadcast.channel, g->broadcast.addr);
+
+    case GUARD_BATCHIN:
+        // enable batch channel input (as a channel)
+        return enable_channel_input(
+            (Channel *)g->batch.channel, i, partner);
+
+    case GUARD_BATCHOUT:
+        // enable batch channel output
+        return enable_batch_output(g->batch.channel, 
+            g->batch.addr, g->batch.n, partner);
+
+    case GUARD_ARRAYOUT:
+        // enable output on channel of array
+        return enable_array_output(g->replicated.array, 
+            g->replicated.n, g->replicated.addr, partner);
+    }//switch
+    return false;
+}
+
+/**
+ *  Disables given guard, returning true if it is ready.
+ */
+static _Bool disable_guard(Guard *g)
+{
+    // INTERRUPTS DISABLED
+    Process *waiting;    // partner waiting in a (maybe unselected) channel
+    switch(g->type) {
+
+    case GUARD_CHANIN:
+    case GUARD_MSGIN:
+    case GUARD_SMALLIN:
+        return disable_channel_input(g->chanin.channel, &waiting);
+
+    case GUARD_CHANOUT:
+    case GUARD_SMALLOUT:
+    case GUARD_ARRAYOUT:
+    case GUARD_SHAREDOUT:
+    case GUARD_BCASTOUT:
+    case GUARD_BATCHOUT:
+    case GUARD_SKIP:
+        return true;
+
+    case GUARD_TIMEOUT:
+        return disable_timeout(g->timeout);
+
+    case GUARD_INTERRUPT:
+        return disable_interrupt_channel(g->interrupt.channel);
+
+    case GUARD_BUFIN:
+        return disable_buffered_input(g->buffered.channel);
+
+    case GUARD_BUFOUT:
+        return disable_buffered_output(g->buffered.channel);
+
+    case GUARD_ARRAYIN:
+        return disable_array_input(g->replicated.array);
+
+    case GUARD_SHAREDIN:
+        return disable_shared_input(g->shared.channel);
+
+    case GUARD_BCASTIN:
+        return disable_broadcast_input(
+            g->broadcast.channel, g->broadcast.reader);
+
+    case GUARD_BATCHIN:
+        return disable_channel_input((Channel *)g->batch.channel, &waiting);
+    }//switch
+    return false;
+}
+
+/**
+ *  Enables given process's event-driven ALT and returns true if
+ *  it found a ready branch.  Each branch enabled is noted in the
+ *  ALT's enabled set, and its index is left where the partner, 
+ *  timer or interrupt that readies it can mark it in the ready set.
+ */
+static _Bool enable_alt_event(
+    Process *proc, AltState *state, Process **partner)
+{
+    // INTERRUPTS ENABLED
+
+    // get pointer to Alternation record in Process record
+    Alternation *alt = alternation(proc);
+
+    // initialize ready indicator and returned i/o partner,
+    // and clear enabled and ready sets
+    _Bool ready = false;
+    *partner = NULL;
+    state->enabled = 0;
+    STORE(&state->ready, 0);
+
+    // if ALT PRI start at 0th branch, if fair ALT
+    // start at next branch past branch last selected 
+    int nrGuards = alt->nrGuards;
+    int i = alt->index + 1;
+    if (alt->alt_pri || i >= nrGuards) {
+        i = 0;
+    }
+
+    // for each guard, in ascending order..
+    _Bool activeOutput = false;
+    int k;
+    for (k = 0; k < nrGuards; k++) {
+        Guard *g  = &state->guards[i];
+
+        // provided guard is active, enable it, 
+        // leaving loop if it is ready
+        if (g->active) {
+            if (is_output_guard(g)) {
+                activeOutput = true;
+            }
+            state->enabled |= (1U << i);
+            DISABLE;
+            ready = enable_guard(g, i, partner);
+            if (ready) {
+                mark_ready(proc, i);
+                break;
+            }
+            ENABLE;
+        }
+        if (++i == nrGuards) {
+            i = 0;
+        }
+    }
+    if (!ready) {
+        DISABLE;
+    }
+    // INTERRUPTS DISABLED
+
+    // make sure output guard restriction holds
+    // (an output guard was enabled with some other guard)
+    if (activeOutput && (state->enabled & (state->enabled - 1)) != 0) {
+        error("Chanout guard must be only active guard");
+    }
+
+    // return ready indicator
+    return ready;
+}
+
+/**
+ *  Enables given process's persistent ALT and returns true if it has
+ *  a ready branch.  Guards enabled in earlier activations stay enabled
+ *  and keep marking their branches ready; only the branches changed 
+ *  since (including the one last selected) are enabled afresh.
+ */
+static _Bool enable_alt_persistent(
+    Process *proc, AltState *state, Process **partner)
+{
+    // INTERRUPTS ENABLED
+    *partner = NULL;
+#if SMP
+    // make state Enabling visible before looking at the ready set,
+    // so a partner marking a branch after the look readies the process
+    FENCE;
+#endif
+
+    // enable each changed branch that is active
+    _Bool activeOutput = false;
+    uint32_t dirty = state->dirty;
+    state->dirty = 0;
+    while (dirty != 0) {
+        int i = __builtin_ctz(dirty);
+        dirty &= dirty - 1;
+        Guard *g = &state->guards[i];
+        if (g->active && !(state->enabled & (1U << i))) {
+            if (is_output_guard(g)) {
+                activeOutput = true;
+            }
+            state->enabled |= (1U << i);
+            DISABLE;
+            if (enable_guard(g, i, partner)) {
+                mark_ready(proc, i);
+            }
+            ENABLE;
+        }
+    }
+    DISABLE;
+    // INTERRUPTS DISABLED
+
+    // make sure output guard restriction holds
+    if (activeOutput && (state->enabled & (state->enabled - 1)) != 0) {
+        error("Chanout guard must be only active guard");
+    }
+
+    // ready if any enabled branch is marked ready
+    return (LOAD(&state->ready) & state->enabled) != 0;
+}
+
+/**
+ *  Enables given process's ALT when only its given branch is active,
+ *  returning true if the branch is ready.  The branch is left as the
+ *  only one disable_alt has to look at.
+ */
+static _Bool enable_single(Process *proc, int i, Process **partner)
+{
+    // INTERRUPTS ENABLED
+    Alternation *alt = alternation(proc);
+    *partner = NULL;
+    alt->index = i;
+    alt->count = 0;
+    AltState *state = alt_state(alt);
+    if (state != NULL) {
+        state->offering = false;
+    }
+    Guard *g = &alt_guards(alt)[i];
+    DISABLE;
+    return g->active && enable_guard(g, i, partner);
+}
+
+/**
+ *  Enables given process's ALT and returns true if
+ *  it found a ready branch.
+ */
+static _Bool enable_alt(Process *proc, Process **partner)
+{
+    // INTERRUPTS ENABLED
+
+    // get pointer to Alternation record in Process record
+    Alternation *alt = alternation(proc);
+    AltState *state = alt_state(alt);
+    if (state != NULL && state->event) {
+        if (state->persistent) {
+            return enable_alt_persistent(proc, state, partner);
+        }
+        return enable_alt_event(proc, state, partner);
+    }
+    Guard *guards = alt_guards(alt);
+
+    // a single guard needs no output guard check or search
+    int nrGuards = alt->nrGuards;
+    if (nrGuards == 1) {
+        return enable_single(proc, 0, partner);
+    }
+
+    // initialize ready indicator and returned i/o partner
+    _Bool ready = false;
+    *partner = NULL;
+
+    // make sure output guard restriction holds, noting
+    // the active guard in case it is the only one
+    int i; 
+    _Bool activeOutput;
+    int nrActive;
+    int single = 0;
+    for (i = 0, activeOutput = false, nrActive = 0;
+         i < nrGuards;
+         i++) {
+        Guard *g = &guards[i]; 
+        if (g->active) {
+            nrActive++;
+            single = i;
+            if (is_output_guard(g)) {
+                activeOutput = true;
+            }
+        }
+    }
+    if (nrActive == 1) {
+        return enable_single(proc, single, partner);
+    }
+
+    // a symmetric ALT may enable plain channel outputs along with
+    // other guards, and nothing is committed till a branch is claimed
+    _Bool offering = false;
+    if (activeOutput) {
+        if (state == NULL) {
+            error("Chanout guard must be only active guard");
+        }
+        for (i = 0; i < nrGuards; i++) {
+            Guard *g = &guards[i];
+            if (g->active && is_output_guard(g) && 
+                    g->type != GUARD_CHANOUT) {
+                error("Chanout guard must be only active guard");
+            }
+        }
+        STORE(&state->claim, NULL);
+        offering = true;
+    }
+    if (state != NULL) {
+        STORE(&state->offering, offering);
+    }
+        
+    // if ALT PRI start at 0th branch, if fair ALT
+    // start at next branch past branch last selected 
+    int k;
+    if (alt->alt_pri) {
+        i = 0;
+     } else {
+        i = plus1_mod(alt->index, nrGuards);
+     }
+     k = 0;
+
+    // for each guard, in ascending order..
+    for (; k < nrGuards; 
+           k++, i = plus1_mod(i, nrGuards)) {
+        Guard *g  = &guards[i];
+
+        // provided guard is active, enable it, 
+        // leaving loop if it is ready
+        if (g->active) {
+            DISABLE;
+            ready = enable_guard(g, i, partner);
+            if (ready) goto Ready;
+            if (*partner != NULL && offering) {
+                // ready inputter displaced by an offer
+                readyProcessIfNecessary(*partner);
+                *partner = NULL;
+            }
+            ENABLE;
+        }//if active
+    }//for 
+    // no ready branch
+
+    // step back to last guard processed
+    i = minus1_mod(i, nrGuards); 
+    k--;
+    DISABLE;
+
+Ready:
+    // INTERRUPTS DISABLED
+
+    // preserve index and count for disable_alt 
+    alt->index = i;
+    alt->count = k;
+
+    // return ready indicator
+    return ready;
+}
+
+/**
+ *  Claims given outputter in a symmetric ALT for input from given 
+ *  channel, returning true if successful (false if the outputter is
+ *  committed elsewhere, or is not offering output on the channel).
+ */
+static _Bool claim_output(AltState *state, Process *outputter, Channel *chan)
+{
+    // INTERRUPTS DISABLED
+    Channel *open = NULL;
+    if (!CAS(&state->claim, &open, chan)) {
+        return false;                    // committed elsewhere
+    }
+    if (LOAD(&chan->waiting) == outputter) {
+        return true;                     // committed to us
+    }
+    // claimed it before it offered on channel (or after it withdrew
+    // and enabled again): give the claim back, and ready it in case 
+    // it is waiting to see what becomes of the claim
+    STORE(&state->claim, NULL);
+    readyProcessIfNecessary(outputter);
+    return false;
+}
+
+/**
+ *  Returns the outputter waiting in given channel, first claiming
+ *  it if it is in a symmetric ALT, or NULL if it has withdrawn or 
+ *  is committed elsewhere.
+ */
+static Process *take_outputter(Channel *chan)
+{
+    // INTERRUPTS ENABLED
+    Process *outputter = LOAD(&chan->waiting);
+    AltState *state;
+    if (outputter != NULL && (state = alt_state(&outputter->alt)) != NULL &&
+            LOAD(&state->offering)) {
+        DISABLE;
+        _Bool claimed = claim_output(state, outputter, chan);
+        ENABLE;
+        if (!claimed) return NULL;
+    }
+    return outputter;
+}
+
+/**
+ *  Completes the selected branch of an ALT, performing i/o if
+ *  appropriate and returning the i/o partner if any (or ALT_RETRY
+ *  if the outputter of a selected input has gone elsewhere).
+ */
+static Process *complete_branch(Alternation *alt)
+{
+    // INTERRUPTS ENABLED
+
+    // initialize returned i/o partner
+    Process *partner = NULL;
+
+    // If selected branch is an input, transfer the data and
+    // return the outputter as partner (outputters waiting in
+    // unselected channels stay waiting)
+    Guard *g = &alt_guards(alt)[alt->index];
+    if (g->type == GUARD_CHANIN) {
+        // Note partner is not executing yet, so don't need to disable.
+        Channel *chan = g->chanin.channel;
+        partner = take_outputter(chan);
+        if (partner == NULL) return ALT_RETRY;    // (gone elsewhere)
+        Memcpy(g->chanin.dest, LOAD(&chan->src), g->chanin.len);  // xfr data
+        STORE(&chan->waiting, NULL);              // set channel empty
+
+    // If selected branch is a small channel input, copy the 
+    // message from the channel with inline moves
+    } else if (g->type == GUARD_SMALLIN) {
+        SmallChannel *chan = (SmallChannel *)g->chanin.channel;
+        partner = LOAD(&chan->waiting);
+        copy_small(g->chanin.dest, chan->data, g->chanin.len);  // xfr data
+        STORE(&chan->waiting, NULL);              // set channel empty
+
+    // If selected branch is a message input, move the message,
+    // leaving the outputter without it
+    } else if (g->type == GUARD_MSGIN) {
+        Channel *chan = g->chanin.channel;
+        partner = take_outputter(chan);
+        if (partner == NULL) return ALT_RETRY;    // (gone elsewhere)
+        Message **src = LOAD(&chan->src);
+        *(Message **)g->chanin.dest = *src;       // xfr message
+        *src = NULL;                              // (receiver owns it now)
+        STORE(&chan->waiting, NULL);              // set channel empty
+
+    // If selected branch is a channel array input, select the
+    // channel and input from it as from an ordinary channel
+    } else if (g->type == GUARD_ARRAYIN) {
+        DISABLE;
+        Channel *chan = select_array_channel(g->replicated.array);
+        ENABLE;
+        partner = LOAD(&chan->waiting);
+        Memcpy(g->replicated.addr, LOAD(&chan->src), g->replicated.n);
+        STORE(&chan->waiting, NULL);              // set channel empty
+
+    // If selected branch is a shared channel input, input from
+    // the writer that has waited longest
+    } else if (g->type == GUARD_SHAREDIN) {
+        partner = take_writer(g->shared.channel, 
+            g->shared.addr, g->shared.len);
+
+    // If selected branch is a broadcast channel input, take this
+    // reader's copy, and the writer if it was the last to do so
+    } else if (g->type == GUARD_BCASTIN) {
+        partner = take_broadcast(g->broadcast.channel, 
+            g->broadcast.reader, g->broadcast.addr, g->broadcast.len);
+
+    // If selected branch is a batch channel input, copy as many
+    // of the items offered as fit, noting how many for both ends
+    } else if (g->type == GUARD_BATCHIN) {
+        BatchChannel *chan = g->batch.channel;
+        partner = LOAD(&chan->waiting);
+        unsigned int n = LOAD(&chan->count);
+        if (n > g->batch.n) n = g->batch.n;
+        Memcpy(g->batch.addr, LOAD(&chan->src), n * chan->size);
+        STORE(&chan->taken, n);
+        STORE(&chan->waiting, NULL);              // set channel empty
+
+    // If selected branch is an interrupt, clear the interrupt
+    // count, first tranferring it if it is wanted
+    } else if (g->type == GUARD_INTERRUPT) {
+        InterruptChannel *chan = g->interrupt.channel;
+        DISABLE;         
+        int count = EXCH(&chan->count, 0);
+        if (g->interrupt.dest != NULL) {
+            *(int *)g->interrupt.dest = count;
+        }
+        ENABLE;
+
+    // If selected branch is a periodic timeout, move it on to
+    // its next period, to be enabled again as it is
+    } else if (g->type == GUARD_TIMEOUT) {
+        if (g->timeout->period != 0) {
+            next_period(g->timeout);
+        }
+
+    // If selected branch is a buffered channel, take or put the
+    // item, returning the partner waiting for it if any
+    } else if (g->type == GUARD_BUFIN) {
+        DISABLE;
+        partner = take_item(g->buffered.channel, g->buffered.addr);
+        ENABLE;
+    } else if (g->type == GUARD_BUFOUT) {
+        DISABLE;
+        partner = put_item(g->buffered.channel, g->buffered.addr);
+        ENABLE;
+    }
+
+    // Return partner if any.
+    return partner;
 }
 
 /**
- *  Enables an interrupt channel to receive an interrupt.
+ *  Disables given process's event-driven ALT, selecting a ready 
+ *  branch and returning the i/o partner if the selected branch is 
+ *  an input.  Only the branches enabled are disabled, and the branch
+ *  is selected from the ready set by a bit scan.
  */
-static _Bool enable_interrupt_channel(InterruptChannel *chan)
+static Process *disable_alt_event(Process *proc, AltState *state)
 {
-    // INTERRUPTS DISABLED
-    if (chan->count == 0) {
-        chan->waiting = current;  // no interrupt yet, wait in channel
-        return false;             // not ready 
+    // INTERRUPTS ENABLED, proc->state = Ready
+
+    // get pointer to Alternation record in Process record
+    Alternation *alt = alternation(proc);
+
+    // disable each enabled branch, bringing the ready set up to
+    // date (a branch may have become ready since it was marked, and
+    // an output branch is ready once its partner has taken the data)
+    uint32_t ready = LOAD(&state->ready);
+    uint32_t enabled = state->enabled;
+    while (enabled != 0) {
+        int i = __builtin_ctz(enabled);
+        enabled &= enabled - 1;
+        DISABLE;
+        _Bool branch_ready = disable_guard(&state->guards[i]);
+        ENABLE;
+        if (branch_ready) {
+            ready |= (1U << i);
+        } else {
+            ready &= ~(1U << i);
+        }
+    }
+    if (ready == 0) {
+        return ALT_RETRY;            // (an offer was withdrawn)
+    }
+
+    // select lowest ready branch if ALT PRI, otherwise lowest ready 
+    // branch past branch last selected (wrapping around to lowest)
+    uint32_t past = ready & ~((2U << alt->index) - 1);
+    if (!alt->alt_pri && past != 0) {
+        alt->index = __builtin_ctz(past);
     } else {
-        return true;              // ready
+        alt->index = __builtin_ctz(ready);
     }
+
+    // complete the selected branch
+    return complete_branch(alt);
 }
 
 /**
- *  Disables an interrupt channel.
+ *  Disables given process's persistent ALT, selecting a ready branch
+ *  and returning the i/o partner if the selected branch is an input.
+ *  Only the selected branch is disabled; the rest stay enabled.
  */
-static _Bool disable_interrupt_channel(InterruptChannel *chan)
+static Process *disable_alt_persistent(Process *proc, AltState *state)
 {
-    // INTERRUPTS DISABLED
-    chan->waiting = NULL;             // we're not waiting now
-    return (chan->count > 0);         // ready if interrupt has occurred
-}
+    // INTERRUPTS ENABLED, proc->state = Ready
 
-/** Adds 1 modulo given modulus */
-static inline int plus1_mod(int i, int m) { 
-    return (i + 1) % m; 
-}
+    // get pointer to Alternation record in Process record
+    Alternation *alt = alternation(proc);
 
-/** Subtracts 1 modulo given modulus */
-static inline int minus1_mod(int i, int m) {
-    // assume 0 <= i < m
-    return (i - 1 + m) % m;
+    // select lowest ready branch if ALT PRI, otherwise lowest ready 
+    // branch past branch last selected (wrapping around to lowest).
+    // With none marked, the process was readied by the inputter 
+    // taking its output, the only branch enabled.
+    uint32_t ready = LOAD(&state->ready) & state->enabled;
+    uint32_t past = ready & ~((2U << alt->index) - 1);
+    if (ready == 0) {
+        if (state->enabled == 0) return ALT_RETRY;
+        alt->index = __builtin_ctz(state->enabled);
+    } else if (!alt->alt_pri && past != 0) {
+        alt->index = __builtin_ctz(past);
+    } else {
+        alt->index = __builtin_ctz(ready);
+    }
+
+    // disable the selected branch, to be enabled again next time
+    uint32_t bit = 1U << alt->index;
+    DISABLE;
+    _Bool branch_ready = disable_guard(&state->guards[alt->index]);
+    ENABLE;
+    state->enabled &= ~bit;
+    AND(&state->ready, ~bit);
+    state->dirty |= bit;
+    if (!branch_ready) {
+        return ALT_RETRY;            // (an offer was withdrawn)
+    }
+
+    // complete the selected branch
+    return complete_branch(alt);
 }
 
 /**
- *  Enables given process's ALT and returns true if
- *  it found a ready branch.
+ *  Disables given process's symmetric ALT, selecting a ready branch
+ *  and returning the i/o partner if the selected branch is an input.
+ *  The process commits to a branch by claiming itself, unless an
+ *  inputter has already claimed it for one of its outputs, and then
+ *  withdraws its other offers.
  */
-static _Bool enable_alt(Process *proc, Process **partner)
+static Process *disable_alt_symmetric(Process *proc, AltState *state)
 {
-    // INTERRUPTS ENABLED
+    // INTERRUPTS ENABLED, proc->state = Ready
 
     // get pointer to Alternation record in Process record
     Alternation *alt = alternation(proc);
 
-    // initialize ready indicator and returned i/o partner
-    _Bool ready = false;
-    *partner = NULL;
-
-    // make sure output guard restriction holds
+    // disable each guard but the outputs, in descending order
+    // from last guard processed by enable_alt, noting a ready one
+    int i = alt->index;
+    int k = alt->count;
     int nrGuards = alt->nrGuards;
-    int i; 
-    _Bool activeOutput;
-    int nrActive;
-    for (i = 0, activeOutput = false, nrActive = 0;
-         i < nrGuards;
-         i++) {
-        Guard *g = &alt->guards[i]; 
-        if (g->active) {
-            nrActive++;
-            if (g->type == GUARD_CHANOUT) {
-                activeOutput = true;
-            }
+    int selected = -1;
+    for (; k >= 0;
+           k--, i = minus1_mod(i, nrGuards)) {
+        Guard *g = &state->guards[i];
+        if (g->active && g->type != GUARD_CHANOUT) {
+            DISABLE;
+            _Bool ready = disable_guard(g);
+            ENABLE;
+            if (ready) selected = i;
         }
     }
-    if (activeOutput && nrActive > 1) {
-        error("Chanout guard must be only active guard");
-    }
-        
-    // if ALT PRI start at 0th branch, if fair ALT
-    // start at next branch past branch last selected 
-    int k;
-    if (alt->alt_pri) {
-        i = 0;
-     } else {
-        i = plus1_mod(alt->index, nrGuards);
-     }
-     k = 0;
-
-    // for each guard, in ascending order..
-    for (; k < nrGuards; 
-           k++, i = plus1_mod(i, nrGuards)) {
-        Guard *g  = &alt->guards[i];
-
-        // provided guard is active..
-        if (g->active) {
-            switch(g->type) {
-
-            case GUARD_CHANIN:
-                // enable channel input, leave loop if channel ready
-                DISABLE;
-                ready = enable_channel_input(g->chanin.channel, partner);
-                if (ready) goto Ready;
-                ENABLE;
-                break;
-
-            case GUARD_CHANOUT:
-                // enable channel output, leave loop if channel ready
-                DISABLE;
-                ready = enable_channel_output(
-                    g->chanout.channel, g->chanout.src, partner);
-                if (ready) goto Ready;
-                ENABLE;
-                break;
-
-            case GUARD_SKIP:
-                // skip guards are always ready
-                DISABLE;
-                ready = true;
-                goto Ready;
-                break;
-
-            case GUARD_TIMEOUT:
-                // enable timeout, leave loop if ready
-                DISABLE;
-                ready = enable_timeout(g->timeout); 
-                if (ready) goto Ready;
-                ENABLE;
-                break;
-
-            case GUARD_INTERRUPT:
-                // enable interrupt channel, leave loop if ready
-                DISABLE;
-                ready = enable_interrupt_channel(g->interrupt.channel);
-                if (ready) goto Ready;
-                break;
-            }//switch
-        }//if active
-    }//for 
-    // no ready branch
 
-    // step back to last guard processed
-    i = minus1_mod(i, nrGuards); 
-    k--;
     DISABLE;
+Commit:
+    // commit to the ready branch, unless an inputter has claimed
+    // one of our outputs
+    {
+        Channel *claim = NULL;
+        if (!CAS(&state->claim, &claim, CLAIM_SELF)) {
+            // find the output the inputter claimed
+            int c;
+            for (c = 0; c < nrGuards; c++) {
+                Guard *g = &state->guards[c];
+                if (g->active && g->type == GUARD_CHANOUT && 
+                        g->chanout.channel == claim) {
+                    break;
+                }
+            }
+            // unless the inputter is done with it, wait for the 
+            // inputter to ready us (it may be giving the claim back)
+            if (c == nrGuards || LOAD(&claim->waiting) == proc) {
+                change_state(proc, PROC_READY, PROC_WAITING);
+                if ((LOAD(&state->claim) != claim || 
+                     (c < nrGuards && LOAD(&claim->waiting) != proc)) &&
+                    change_state(proc, PROC_WAITING, PROC_READY)) {
+                    goto Commit;         // it was meanwhile
+                }
+                alt->count = -1;         // guards already disabled
+                ENABLE;
+                return ALT_WAIT;
+            }
+            selected = c;
+        }
+    }
 
-Ready:
-    // INTERRUPTS DISABLED
-
-    // preserve index and count for disable_alt 
-    alt->index = i;
-    alt->count = k;
+    // withdraw our other offers (an offer no longer ours was taken
+    // over by an inputter waiting in the channel, so leave it)
+    for (i = 0; i < nrGuards; i++) {
+        Guard *g = &state->guards[i];
+        if (g->active && g->type == GUARD_CHANOUT && i != selected) {
+            Process *offer = proc;
+            CAS(&g->chanout.channel->waiting, &offer, NULL);
+        }
+    }
+    ENABLE;
+    if (selected < 0) {
+        return ALT_RETRY;            // (an offer was withdrawn)
+    }
+    alt->index = selected;
 
-    // return ready indicator
-    return ready;
+    // complete the selected branch
+    return complete_branch(alt);
 }
 
 /**
  *  Disables given process's ALT, selecting a ready branch and 
- *  returning the i/o partner if the selected branch is an input.
+ *  returning the i/o partner if the selected branch is an input
+ *  (or ALT_RETRY or ALT_WAIT, see above).
  */
 static Process *disable_alt(Process *proc)
 {
     // INTERRUPTS ENABLED, proc->state = Ready
 
-    // initialize returned i/o partner
-    Process *partner = NULL;
-
     // get pointer to Alternation record in Process record
     Alternation *alt = alternation(proc);
+    AltState *state = alt_state(alt);
+    if (state != NULL) {
+        if (state->event) {
+            if (state->persistent) {
+                return disable_alt_persistent(proc, state);
+            }
+            return disable_alt_event(proc, state);
+        }
+        if (state->offering) {
+            return disable_alt_symmetric(proc, state);
+        }
+    }
 
     // start with last guard processed by enable_alt
+    Guard *guards = alt_guards(alt);
     int i = alt->index;
     int k = alt->count;
     int nrGuards = alt->nrGuards;
 
     // for each guard, in descending order..
+    _Bool found = false;
     for (; k >= 0;
            k--, i = minus1_mod(i, nrGuards)) {
-        Guard *g = &alt->guards[i];
+        Guard *g = &guards[i];
         if (g->active) {
-            _Bool ready;
-            switch(g->type) {
-
-            case GUARD_CHANIN:
-                DISABLE;
-                ready = disable_channel_input(g->chanin.channel, &partner);
-                ENABLE;
-                if (ready) alt->index = i;
-                break;
-
-            case GUARD_CHANOUT:
-                alt->index = i;
-                break;
-
-            case GUARD_SKIP:
+            DISABLE;
+            _Bool ready = disable_guard(g);
+            ENABLE;
+            if (ready) {
                 alt->index = i;
-                break;
-
-            case GUARD_TIMEOUT:
-                DISABLE;
-                ready = disable_timeout(g->timeout);
-                ENABLE;
-                if (ready) alt->index = i;
-                break;
-
-            case GUARD_INTERRUPT:
-                DISABLE;
-                ready = disable_interrupt_channel(g->interrupt.channel);
-                ENABLE; 
-                if (ready) alt->index = i;
-            }//switch
+                found = true;
+            }
         }//if
     }//for
     // alt->index contains index of selected branch
+    if (!found) {
+        return ALT_RETRY;            // (an offer was withdrawn)
+    }
 
-    // INTERRUPTS DISABLED
+    // complete the selected branch
+    return complete_branch(alt);
+}
 
-    // If selected branch is an input, transfer the data
-    Guard *g = &alt->guards[alt->index];
-    if (g->type == GUARD_CHANIN) {
-        // Note partner is not executing yet, so don't need to disable.
-        Channel *chan = g->chanin.channel;
-        Memcpy(g->chanin.dest, chan->src, g->chanin.len);  // xfr data
-        chan->waiting = NULL;	                  // set channel empty
+#if SMP
+/**
+ *  Steals a ready process from the tail of another core's queues
+ *  and makes it this core's own.  Returns true if successful.
+ */
+static _Bool steal()
+{
+    // INTERRUPTS ENABLED
+    int n = ncores;
+    int i;
+    for (i = 1; i < n; i++) {
+        Core *victim = &cores[(core - cores + i) % n];
 
-    // If selected branch is an interrupt, clear the interrupt
-    // count, first tranferring it if it is wanted
-    } else if (g->type == GUARD_INTERRUPT) {
-        InterruptChannel *chan = g->interrupt.channel;
-        DISABLE;         
-        if (g->interrupt.dest != NULL) {
-            *(int *)g->interrupt.dest = chan->count;
+        // don't bother unless victim seems to have something
+        // above its idle level
+        if (!ready_above_idle(victim)) {
+            continue;
+        }
+
+        // take a process and make it ours
+        DISABLE;
+        Process *proc = take_tail(victim);
+        if (proc != NULL) {
+            proc->core = core - cores;
+            append(proc);
+            core->steals++;
+        } else {
+            core->failed_steals++;  // lost race or all pinned
         }
-        chan->count = 0;  
         ENABLE;
+        if (proc != NULL) return true;
     }
-
-    // Return partner if any.
-    // (At most one partner was returned by called routines above.)
-    return partner;
+    return false;
 }
+#endif
 
 /**
  *  RTC function of the idle process.
@@ -705,7 +2553,95 @@ static Process *disable_alt(Process *proc)
 static void idle(void *local)
 {
 Printf("In idle process\n");
-    while (true);
+#if SMP
+    // run processes other cores make ready here, 
+    // or failing that, processes stolen from other cores
+    while (true) {
+        if (ready_above_idle(core) || steal()) {
+            DISABLE;
+            schedule(PRI_MIN);
+            ENABLE;
+        }
+        CPU_RELAX;
+    }
+#else
+    // the only work left comes from interrupt handlers, which run
+    // the scheduler over this code, so sleep until the next one
+    // (time is read from the clock, so only timeouts due and i/o
+    // interrupts wake an idle core)
+    while (true) {
+        wait_for_interrupt();
+    }
+#endif
+}
+
+/**
+ *  Makes given i/o partner ready if it isn't already.  If the partner
+ *  takes direct handoffs, it goes to the head of its ready queue, so it
+ *  runs as soon as the current process's RTC returns, while its data is
+ *  still in cache.  (Only HANDOFF_MAX handoffs in a row are allowed, so 
+ *  the rest of the queue is not starved.)
+ */
+static void readyPartner(Process *partner)
+{
+    // INTERRUPTS MUST BE DISABLED
+    if (!partner->handoff || partner->pri != current->pri || 
+            HOME(partner) != core || core->handoffs >= HANDOFF_MAX) {
+        core->handoffs = 0;
+        readyProcessIfNecessary(partner);
+        return;
+    }
+
+    // advance partner to Ready as readyProcessIfNecessary does,
+    // but put it at the head of its queue
+    if (change_state(partner, PROC_ENABLING, PROC_READY)) {
+        return;
+    }
+    if (!change_state(partner, PROC_WAITING, PROC_READY)) {
+        return;
+    }
+    push(partner);
+    core->handoffs++;
+    core->total_handoffs++;
+}
+
+/**
+ *  If a process above the given one's priority is ready on this 
+ *  core, puts the given one back at the head of its ready queue in
+ *  given state, and returns true.
+ */
+static _Bool yield_to_higher(Process *proc, int8_t state)
+{
+    // INTERRUPTS DISABLED
+    core->preempt = false;
+    if (highest_ready() <= proc->pri) {
+        return false;
+    }
+    proc->state = state;
+    push(proc);
+    return true;
+}
+
+/**
+ *  Sets process's state after disabling its ALT, given the partner
+ *  disable_alt returned, and returns true if the process should run
+ *  its RTC code.  After ALT_RETRY the process enables its ALT again
+ *  (it is left Quiescent); after ALT_WAIT it is left Waiting.
+ */
+static _Bool finish_alt(Process *proc, Process **partner, int *state)
+{
+    if (*partner == ALT_WAIT) {
+        *partner = NULL;
+        *state = PROC_WAITING;
+        return false;
+    }
+    proc->state = PROC_QUIESCENT;
+    if (*partner == ALT_RETRY) {
+        *partner = NULL;
+        *state = PROC_QUIESCENT;
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -717,6 +2653,9 @@ void schedule(int base_pri)
 {
     // INTERRUPTS DISABLED
     Process *proc = NULL;     // the process running in this scheduler   //X
+    Process *prev = current;  // the process this scheduler preempted    //X
+    _Bool in_rtc = core->in_rtc;  // true if it preempted its RTC code   //X
+    core->in_rtc = false;                                                //X
     while (true) {                                                       //X
                                                                          //X
         if (proc == NULL) {                                              //X
@@ -726,13 +2665,18 @@ void schedule(int base_pri)
             int highest = highest_ready();                               //X
                                                                          //X
             // return if it's no higher than that of previously          //X
-            // running scheduler                                         //X
+            // running scheduler, restoring the preempted process        //X
             if (highest <= base_pri) {                                   //X
+                set_current(prev);                                       //X
+                core->in_rtc = in_rtc;                                   //X
                 return;                                                  //X
             }                                                            //X
                                                                          //X
             // take highest-priority ready process current               //X
-            proc = current = take(highest);                              //X
+            // (unless another core stole it meanwhile)                  //X
+            proc = take(highest);                                        //X
+            if (proc == NULL) continue;                                  //X
+            set_current(proc);                                           //X
         }                                                                //X
                                                                          //X
         // get scheduling state of current process                       //X
@@ -748,9 +2692,18 @@ void schedule(int base_pri)
         if (state == PROC_INITIAL) {                                
                                                                         
             // execute process's RTC code and advance state to Quiescent
+            core->in_rtc = true;
             proc->rtc(LOCAL(proc));                                    
+            core->in_rtc = false;
             proc->state = PROC_QUIESCENT;                                   
                                                                      
+        // if process was put back on its queue before its RTC code ran..
+        } else if (state == PROC_SELECTED) {
+
+            // execute it now
+            execute = true;
+            proc->state = PROC_QUIESCENT;
+                                                                     
         // if process is not involved in an ALT..                   
         } else if (state == PROC_QUIESCENT) {                      
                                                                   
@@ -760,10 +2713,10 @@ void schedule(int base_pri)
             // INTERRUPTS DISABLED                                       //X
                                                                          //X
             // advance state to Ready if enable_alt found a ready        //X
-            // branch otherwise to Waiting                               //X
-            if (proc->state == PROC_ENABLING) {                          //X
-                proc->state = (ready ? PROC_READY : PROC_WAITING);       //X
-            }                                                            //X
+            // branch otherwise to Waiting (unless a partner readied     //X
+            // the process meanwhile)                                    //X
+            change_state(proc, PROC_ENABLING,                            //X
+                         ready ? PROC_READY : PROC_WAITING);             //X
                                                                          //X
             // allow interrupts                                          //X
             state = proc->state;                                         //X
@@ -779,8 +2732,7 @@ void schedule(int base_pri)
                                                                         
                 // prepare to execute process's RTC code and           
                 // set state to show process not involved in ALT      
-                execute = true;                                      
-                proc->state = PROC_QUIESCENT;                       
+                execute = finish_alt(proc, &partner, &state);
             }                                                      
                                                                   
         // if process if ready (because some partner readied a   
@@ -793,8 +2745,8 @@ void schedule(int base_pri)
                                                                          
             // prepare to execute process's RTC code and                
             // set state to show process not involved in ALT           
-            execute = true;                                           
-            proc->state = PROC_QUIESCENT;                            
+            execute = finish_alt(proc, &partner, &state);
+                                                                         
                                                                     
         } else {                                                   
             //ASSERT(false);                                      
@@ -807,28 +2759,52 @@ void schedule(int base_pri)
             DISABLE;                                                     //X
                                                                          //X
             // ready the partner if it isn't already ready               //X
-            readyProcessIfNecessary(partner);                            //X
+            readyPartner(partner);                                       //X
                                                                          //X
             // allow interrupts                                          //X
             ENABLE;                                                   
         }                                                          
                                                                        
-        // run process's RTC code 
+        // run process's RTC code, unless a process of higher priority
+        // has been readied: then put this one back at the head of its
+        // queue to run its RTC code later, and run that one from this
+        // scheduler rather than from a nested one (an interrupt from
+        // now on preempts the RTC code, see preempt)
         if (execute) {                                                
+            core->in_rtc = true;
+            SIGFENCE;
+            if (LOAD(&core->preempt)) {
+                DISABLE;                                                 //X
+                core->in_rtc = false;                                    //X
+                if (yield_to_higher(proc, PROC_SELECTED)) {              //X
+                    proc = NULL;                                         //X
+                    continue;                                            //X
+                }                                                        //X
+                core->in_rtc = true;                                     //X
+                ENABLE;
+            }
             proc->rtc(LOCAL(proc));                                  
+            core->in_rtc = false;
         }                                                           
                                                                    
         // disallow interrupts                                    
         DISABLE;                                                         //X
                                                                          //X
+        // if process was left waiting (for i/o, timeout or interrupt),  //X
+        // prepare to select new process (don't look at the process      //X
+        // again: once readied it belongs to its ready queue)            //X
+        if (state == PROC_WAITING) {                                     //X
+            proc = NULL;                                                 //X
+                                                                         //X
         // if process has terminated, release its process record         //X
-        if (proc->state == PROC_DONE) {                                  //X
+        } else if (proc->state == PROC_DONE) {                           //X
             release_mem(proc->index, (char *)proc);                      //X
             proc = NULL;                                                 //X
                                                                          //X
-        // if process is waiting (for i/o, timeout or interrupt),        //X
-        // prepare to select new process                                 //X
-        } else if (proc->state == PROC_WAITING) {                        //X
+        // if a process of higher priority has been readied, put this    //X
+        // one back at the head of its queue, and run that one           //X
+        } else if (core->preempt &&                                      //X
+                   yield_to_higher(proc, PROC_QUIESCENT)) {              //X
             proc = NULL;                                                 //X
         }                                                                //X
                                                                          //X
@@ -845,32 +2821,132 @@ void readyProcessIfNecessary(Process *partner)
                                                                          //X
     // if process is still enabling, set its state to Ready              //X
     // for process to find when it disables                              //X
-    if (partner->state == PROC_ENABLING) {                               //X
-        partner->state = PROC_READY;                                     //X
-                                                                         //X
-    // if process is waiting on its ALT..                                //X
-    } else if (partner->state = PROC_WAITING) {                          //X
-                                                                         //X
-        // advance process to Ready and put it on its ready queue        //X
-        partner->state = PROC_READY;                                     //X
-        append(partner);                                                 //X
-                                                                         //X
-        // if partner's priority is higher than current process's..      //X
-        if (partner->pri > current->pri) {                               //X
+    if (change_state(partner, PROC_ENABLING, PROC_READY)) {              //X
+        return;                                                          //X
+    }                                                                    //X
                                                                          //X
-            // save the current process                                  //X
-            Process *prev = current;                                     //X
-                                                                         //X
-            // schedule the partner immediately (preemptively)           //X
-            schedule(prev->pri);                                         //.
+    // if process is waiting on its ALT, advance it to Ready             //X
+    // and put it on its ready queue                                     //X
+    if (!change_state(partner, PROC_WAITING, PROC_READY)) {              //X
+        //ASSERT(false);                                                 //X
+        return;                                                          //X
+    }                                                                    //X
+    append(partner);                                                     //X
                                                                          //X
-            // restore the current process                               //X
-            current = prev;                                              //X
+#if SMP                                                                  //X
+    // if partner lives on another core, interrupt that core if it's     //X
+    // running a lower-priority process (an idle core will find the      //X
+    // partner by itself)                                                //X
+    Core *home = HOME(partner);                                          //X
+    if (home != core) {                                                  //X
+        int running = LOAD(&home->running);                              //X
+        if (partner->pri > running && running != PRI_MIN) {              //X
+            interrupt_core(partner->core);                               //X
         }                                                                //X
                                                                          //X
-    } else {                                                             //X
-        //ASSERT(false);                                                 //X
-    }                                                                    //X 
+    // if partner's priority is higher than current process's,           //X
+    // have the scheduler dispatch it (see preempt)                      //X
+    } else if (partner->pri > current->pri) {                            //X
+        core->preempt = true;                                            //X
+    }                                                                    //X
+#else                                                                    //X
+    // if partner's priority is higher than current process's,           //X
+    // have the scheduler dispatch it (see preempt)                      //X
+    if (partner->pri > current->pri) {                                   //X
+        core->preempt = true;                                            //X
+    }                                                                    //X
+#endif                                                                   //X
+}
+
+/**
+ *  Dispatches any process readied above the current one's priority,
+ *  once interrupt handlers are done.  If they interrupted a process's
+ *  RTC code, a scheduler runs the readied processes above it, nested
+ *  on the stack over the interrupted code.  If they interrupted the
+ *  scheduler itself, it is left to dispatch them before it runs any
+ *  more RTC code, so preemption nests only over RTC code (at most
+ *  one level per priority) and never over the scheduler.
+ */
+void preempt()
+{
+    // INTERRUPTS DISABLED
+    if (core->in_rtc) {
+        schedule(current->pri);
+    } else {
+        core->preempt = true;
+    }
+}
+
+/** 
+ *  Makes the processes of a list of expired timeouts (linked through
+ *  their next fields) ready, marking their branches ready.  Processes
+ *  are appended to their ready queues in expiry order, with each
+ *  core's queues locked once for a run of processes that live there,
+ *  and each core with a process readied above its current one's
+ *  priority is told once.
+ */
+void readyTimeouts(Timeout *list)
+{
+    // INTERRUPTS MUST BE DISABLED
+    int top[MAX_CORES];     // highest priority readied on each core
+    int i;
+    for (i = 0; i < ncores; i++) {
+        top[i] = -1;
+    }
+    Core *locked = NULL;
+    while (list != NULL) {
+        Timeout *timeout = list;
+        list = list->next;
+        Process *proc = timeout->proc;
+        mark_ready(proc, timeout->index);
+
+        // advance process to Ready as readyProcessIfNecessary does
+        if (change_state(proc, PROC_ENABLING, PROC_READY) ||
+                !change_state(proc, PROC_WAITING, PROC_READY)) {
+            continue;
+        }
+        Core *c = HOME(proc);
+        if (c != locked) {
+            if (locked != NULL) UNLOCK(&locked->lock);
+            LOCK(&c->lock);
+            locked = c;
+        }
+        append_locked(c, proc);
+        if (proc->pri > top[c - cores]) {
+            top[c - cores] = proc->pri;
+        }
+    }
+    if (locked != NULL) UNLOCK(&locked->lock);
+
+    // preempt as readyProcessIfNecessary does, once per core
+    for (i = 0; i < ncores; i++) {
+        Core *c = &cores[i];
+        if (top[i] < 0) {
+            continue;
+        } else if (c == core) {
+            if (top[i] > current->pri) {
+                core->preempt = true;
+            }
+#if SMP
+        } else {
+            int running = LOAD(&c->running);
+            if (top[i] > running && running != PRI_MIN) {
+                interrupt_core(i);
+            }
+#endif
+        }
+    }
+}
+
+/** 
+ *  Marks given branch of process's ALT ready, and makes the 
+ *  process ready if it isn't already.
+ */
+void readyBranch(Process *proc, int index)
+{
+    // INTERRUPTS MUST BE DISABLED
+    mark_ready(proc, index);
+    readyProcessIfNecessary(proc);
 }
 
 /** Handles user interrupts */
@@ -879,10 +2955,11 @@ void user_interrupt_handler(int intrsrc)
     // INTERRUPTS MUST BE DISABLED
     InterruptChannel *chan = channel_for_interrupt[intrsrc-INTR_USER0];
     if (chan != NULL) {
-        chan->count += 1;                         // incr interrupt count
-        if (chan->waiting != NULL) {
-            Process *waiting = chan->waiting;     // ready waiting process
-            readyProcessIfNecessary(waiting);
+        INCR(&chan->count, 1);                    // incr interrupt count
+        FENCE;                                    // (pairs with enabler's)
+        Process *waiting = LOAD(&chan->waiting);
+        if (waiting != NULL) {
+            readyBranch(waiting, LOAD(&chan->index));  // ready waiting process
         }
     }
 }
@@ -900,12 +2977,30 @@ void send_software_interrupt(int intrno)
     send_user_interrupt(intrsrc);
 }
 
+/** 
+ *  Returns offset of process's local variables in combined 
+ *  process record/local vars allocation.
+ */
+static size_t record_offset()
+{
+    struct X { Process proc; void *start; };
+    return offsetof(struct X, start);
+}
+
+/** 
+ *  Returns the bytes of memory a process with local variables of
+ *  given size takes, its process record included.
+ */
+unsigned int process_memory(unsigned int local_size)
+{
+    return mem_block_length(record_offset() + local_size);
+}
+
 static void sched_init()
 {
     // Calculate offset of process's local variables in 
     // combined process record/local vars allocation
-    struct X { Process proc; void *start; };
-    proc_offset = offsetof(struct X, start);
+    proc_offset = record_offset();
 
 /***
 #include <stdio.h>
@@ -918,19 +3013,35 @@ Printf("sizeof(Channel) = %d\n", sizeof(c));
 ***/
 
     // initialize the ready queues
-    int i;
-    for (i = PRI_MIN; i <= PRI_MAX; i++) {
-        ReadyQ *q = &readyQ[i];
-        q->head = q->tail = NULL;
-    } 
+    int c, i;
+    for (c = 0; c < MAX_CORES; c++) {
+        for (i = PRI_MIN; i < PRI_LEVELS; i++) {
+            ReadyQ *q = &cores[c].readyQ[i];
+            q->head = q->tail = NULL;
+        } 
+    }
 
     // define user interrupt handlers
     for (i = INTR_USER0; i < NINTR_SOURCES; i++) {
         define_interrupt_handler(i, user_interrupt_handler);
     }
 
-    // start the idle process
-    start_idle(idle);
+    // start the idle process and make it the current process
+    start_idle(idle, 0);
+    current = cores[0].idle;
+}
+
+/** 
+ *  Runs the scheduler on a given core.
+ *  Called on each core's own thread.
+ */
+static void core_main(int c)
+{
+    // INTERRUPTS DISABLED
+    core = &cores[c];
+    current = core->idle;
+    schedule(PRI_MIN-1);
+    //ASSERT(false);
 }
 
 /** Returns true if it is process's initial execution */
@@ -963,7 +3074,12 @@ void run()
 {
     // INTERRUPTS DISABLED
 
-    // engage the scheduler
-    schedule(PRI_MIN-1);
-    //ASSERT(false);
+    // start the other cores' idle processes
+    int c;
+    for (c = 1; c < ncores; c++) {
+        start_idle(idle, c);
+    }
+
+    // engage the scheduler on every core
+    start_cores(ncores, core_main);
 }
@@ -26,14 +26,25 @@ typedef struct Channel Channel;
 typedef struct ChanIn ChanIn;
 typedef struct ChanOut ChanOut;
 typedef struct Guard Guard;
+typedef struct AltState AltState;
+typedef struct BufferedChannel BufferedChannel;
+typedef struct SmallChannel SmallChannel;
+typedef struct ChannelArray ChannelArray;
+typedef struct SharedChannel SharedChannel;
+typedef struct BroadcastChannel BroadcastChannel;
+typedef struct BatchChannel BatchChannel;
 
 #include "internals/sched.h"
 
-// Eight priority levels (0 = Idle process, 7 = most urgent))
+// PRI_LEVELS priority levels (0 = Idle process, PRI_MAX = most urgent);
+// build with e.g. -DPRI_LEVELS=256 for more than eight (up to 256)
+#ifndef PRI_LEVELS
+#define PRI_LEVELS   8
+#endif
 #define PRI_MIN      0
-#define PRI_MAX      7
+#define PRI_MAX      (PRI_LEVELS-1)
 #define PRI_DEFAULT  1
-/** In effect, ISRs run at priority 8 */
+/** In effect, ISRs run at priority PRI_MAX+1 */
 
 /** Macros for defining a process's name and local variables */
 #define               \
@@ -51,6 +62,41 @@ struct P {
 /** Starts a process */
 void start(void (*rtc)(), void *local_struct, unsigned int local_size, int pri);
 
+/** Macro for the bytes of memory (see initialize) a process takes */
+#define PROCESS_MEMORY(P) process_memory(sizeof(P))
+
+/** Returns the bytes of memory a process with local variables of
+ *  given size takes, its process record included */
+unsigned int process_memory(unsigned int local_size);
+
+/** Macro for starting a process on a given core (SMP) */
+#define START_ON(P, parg, pri, core) \
+    start_on(P##_rtc, parg, sizeof(P), pri, core) 
+
+/** Starts a process on a given core (SMP) */
+void start_on(void (*rtc)(), void *local_struct, unsigned int local_size, 
+    int pri, int core);
+
+/** Sets number of cores to run processes on (SMP) */
+void set_cores(int ncores);
+
+/** Scheduler counters */
+typedef struct SchedStats {
+    uint64_t steals;          // # of ready processes stolen by idle cores
+    uint64_t failed_steals;   // # of steal attempts that found nothing
+    uint64_t handoffs;        // # of partners run by direct handoff
+} SchedStats;
+
+/** Returns scheduler counters, summed over cores */
+void get_sched_stats(SchedStats *stats);
+
+/** Sets direct-handoff policy for processes started from now on
+ *  (a process readied by its i/o partner then runs next) */
+void set_handoff(_Bool on);
+
+/** Sets direct-handoff policy for the current process */
+void set_process_handoff(_Bool on);
+
 /** Terminates a process (called by the terminating process) */
 void terminate();
 
@@ -66,6 +112,38 @@ inline ChanOut *out(Channel *chan);
 /** Initializes alternation */
 inline void init_alt(Guard *guards, int size);
 
+/** Initializes alternation with a single guard (an ALT with one 
+ *  guard, or with only one guard active, skips the search for a 
+ *  ready branch) */
+inline void init_single(Guard *guard);
+
+/** Initializes alternation for priority selection */
+void init_alt_pri(Guard *guards, int size);
+
+/** Initializes alternation for event-driven selection (fair, or 
+ *  priority): the partners, timeouts and interrupts that make branches 
+ *  ready mark them, and the branch is chosen from the marks by a bit 
+ *  scan (at most 32 guards; state is storage for the ALT's marks, in 
+ *  the process's locals) */
+void init_alt_event(Guard *guards, int size, AltState *state);
+void init_alt_pri_event(Guard *guards, int size, AltState *state);
+
+/** Initializes persistent alternation (fair, or priority), an 
+ *  event-driven one whose guards stay enabled from one activation to
+ *  the next: only the branch selected and guards activated, 
+ *  deactivated or initialized since are enabled afresh (at most 32 
+ *  guards; call once, in the process's initial activation, with state
+ *  in the process's locals) */
+void init_alt_persistent(Guard *guards, int size, AltState *state);
+void init_alt_pri_persistent(Guard *guards, int size, AltState *state);
+
+/** Initializes symmetric alternation (fair, or priority), which may 
+ *  have channel output guards active along with its other guards: it
+ *  offers every output, and is committed only when a branch is claimed
+ *  (state is storage for the claim, in the process's locals) */
+void init_alt_symmetric(Guard *guards, int size, AltState *state);
+void init_alt_pri_symmetric(Guard *guards, int size, AltState *state);
+
 /** Initializes channel input guard */
 inline void init_chanin_guard(
     Guard *guard, ChanIn *chan, void *dest, unsigned int len);
@@ -77,12 +155,139 @@ inline void init_chanin_guard_for_interrupt(
 /** Initializes channel output guard */
 inline void init_chanout_guard(Guard *guard, ChanOut *chan, void *src);
 
+/** Initializes small channel (carries up to SMALL_MSG_MAX bytes
+ *  in the channel itself) */
+inline void init_small_channel(SmallChannel *chan);
+
+/** Returns the input end of a small channel */
+inline ChanIn *in_small(SmallChannel *chan);
+
+/** Returns the output end of a small channel */
+inline ChanOut *out_small(SmallChannel *chan);
+
+/** Initializes small channel input guard (len <= SMALL_MSG_MAX) */
+inline void init_small_chanin_guard(
+    Guard *guard, ChanIn *chan, void *dest, unsigned int len);
+
+/** Initializes small channel output guard (len <= SMALL_MSG_MAX) */
+inline void init_small_chanout_guard(
+    Guard *guard, ChanOut *chan, void *src, unsigned int len);
+
+/** Bytes of memory a pool of count messages of given size needs */
+#define MESSAGE_POOL_LEN(size, count)  ((count) * MESSAGE_STRIDE(size))
+
+/** Initializes pool of messages with given size of data, 
+ *  carved from given memory of memlen bytes */
+void init_message_pool(MessagePool *pool, 
+    void *memory, unsigned int memlen, unsigned int size);
+
+/** Takes a message from pool (returns NULL if none left) */
+Message *get_message(MessagePool *pool);
+
+/** Returns message to its pool */
+void release_message(Message *msg);
+
+/** Initializes message input guard (the message sent is moved, not 
+ *  copied, to *dest, and the receiver then owns it) */
+inline void init_msgin_guard(Guard *guard, ChanIn *chan, Message **dest);
+
+/** Initializes message output guard (when the output is done, the 
+ *  receiver owns the message and *src is NULL) */
+inline void init_msgout_guard(Guard *guard, ChanOut *chan, Message **src);
+
+/** Initializes buffered channel holding up to capacity items of
+ *  given size in given buffer (of capacity*size bytes) */
+void init_buffered_channel(BufferedChannel *chan, 
+    void *buffer, unsigned int size, unsigned int capacity);
+
+/** Initializes buffered channel input guard (ready while the
+ *  channel holds an item) */
+inline void init_bufin_guard(Guard *guard, BufferedChannel *chan, void *dest);
+
+/** Initializes buffered channel output guard (ready while the
+ *  channel has room for an item) */
+inline void init_bufout_guard(Guard *guard, BufferedChannel *chan, void *src);
+
+/** Words of readiness bits a channel array of size channels needs */
+#define CHANNEL_ARRAY_WORDS(size)  (((size) + 31) / 32 + ((size) + 1023) / 1024)
+
+/** Initializes array of size channels, one inputter can ALT over all 
+ *  of them with one guard, using given readiness bits (of 
+ *  CHANNEL_ARRAY_WORDS(size) words) */
+void init_channel_array(ChannelArray *array, 
+    Channel *channels, uint32_t *bits, int size);
+
+/** Initializes replicated input guard, ready while an outputter waits 
+ *  in any channel of the array (the one input is selected fairly) */
+inline void init_arrayin_guard(
+    Guard *guard, ChannelArray *array, void *dest, unsigned int len);
+
+/** Initializes output guard for given channel of array */
+inline void init_arrayout_guard(
+    Guard *guard, ChannelArray *array, int i, void *src);
+
+/** Returns channel of array last input */
+int selected_channel(ChannelArray *array);
+
+/** Initializes shared channel (any number of writers, one reader;
+ *  writers are served in the order they arrive) */
+void init_shared_channel(SharedChannel *chan);
+
+/** Initializes shared channel input guard */
+inline void init_sharedin_guard(
+    Guard *guard, SharedChannel *chan, void *dest, unsigned int len);
+
+/** Initializes shared channel output guard */
+inline void init_sharedout_guard(Guard *guard, SharedChannel *chan, void *src);
+
+/** Initializes broadcast channel with given number of readers (up
+ *  to BROADCAST_MAX); an output on it is done when every reader has 
+ *  taken a copy of the data */
+void init_broadcast_channel(BroadcastChannel *chan, int nreaders);
+
+/** Initializes broadcast channel input guard for given reader
+ *  (0 to nreaders-1) */
+inline void init_bcastin_guard(Guard *guard, 
+    BroadcastChannel *chan, int reader, void *dest, unsigned int len);
+
+/** Initializes broadcast channel output guard */
+inline void init_bcastout_guard(
+    Guard *guard, BroadcastChannel *chan, void *src);
+
+/** Initializes batch channel for items of given size; a writer offers
+ *  an array of items and the reader takes as many as fit its array 
+ *  in one rendezvous */
+void init_batch_channel(BatchChannel *chan, unsigned int size);
+
+/** Initializes batch channel input guard taking up to max items */
+inline void init_batchin_guard(
+    Guard *guard, BatchChannel *chan, void *dest, unsigned int max);
+
+/** Initializes batch channel output guard offering count items */
+inline void init_batchout_guard(
+    Guard *guard, BatchChannel *chan, void *src, unsigned int count);
+
+/** Returns # of items last passed on batch channel (for the reader 
+ *  or the writer, after its branch is selected) */
+unsigned int batch_count(BatchChannel *chan);
+
 /** Initializes skip guard */
 inline void init_skip_guard(Guard *guard);
 
 /** Initializes timeout guard */
 inline void init_timeout_guard(Guard *guard, Timeout *timeout, Time time);
 
+/** Initializes periodic timeout guard, ready at start and at every
+ *  period after it.  Each time its branch is selected it moves on to
+ *  the next period, so it need not be initialized again; periods
+ *  already passed by then are skipped */
+inline void init_periodic_guard(
+    Guard *guard, Timeout *timeout, Time start, Time period);
+
+/** Returns # of periods skipped when periodic timeout's branch was
+ *  last selected (the process ran too late for them) */
+unsigned int overruns(Timeout *timeout);
+
 /** Activates a guard */
 inline void activate(Guard *guard);
 
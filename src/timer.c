@@ -18,142 +18,291 @@
 
 #include "timer.h"
 #include "hardware.h"
+#include "sched.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// user timer 0 for elapsed time, timer 1 for timeouts
-#define TIMER_ELAPSED TIMER_0
-#define TIMER_TIMEOUT TIMER_1
+// use timer 0 for timeouts
+#define TIMER_TIMEOUT TIMER_0
 
-// time units (nsec) per tick
-static Time Tick = 1000000000ULL;
-//static Time Tick = 100000000000ULL;   // for testing  100 sec.
+/** 
+ *  Timer wheel geometry.  The wheel has WHEEL_LEVELS levels of
+ *  WHEEL_SIZE slots each.  A tick is 2^WHEEL_RES nanoseconds and
+ *  a slot at level l spans WHEEL_SIZE^l ticks, so the levels
+ *  together cover the whole range of Time.
+ */
+#define WHEEL_RES     10                              // ~1 usec ticks
+#define WHEEL_BITS    6
+#define WHEEL_SIZE    (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS  ((64 - WHEEL_RES + WHEEL_BITS - 1) / WHEEL_BITS)
+
+/** 
+ *  Timer wheel descriptor.
+ *  A timeout expiring at tick t is kept at the level holding the 
+ *  highest bit in which t differs from the wheel's time, in the slot
+ *  given by t's bits for that level.  When the wheel's time reaches
+ *  the start of an occupied slot above level 0, the slot's timeouts
+ *  are cascaded to lower levels; when it reaches an occupied slot at
+ *  level 0, the slot's timeouts are due.
+ */
+typedef struct TimerWheel {
+    Timeout *slot[WHEEL_LEVELS][WHEEL_SIZE];    // lists of timeouts
+    uint64_t occupied[WHEEL_LEVELS];  // bit set of nonempty slots per level
+    Time ticks;                       // wheel's time, in ticks
+    Time armed;                       // time timer set for (TIME_MAX if none)
+} TimerWheel;
+
+/** the timer wheel */
+static TimerWheel wheel;
 
-/** Timer queue descriptor */
-typedef struct TimerQ {
-    Timeout *head;
-} TimerQ;
+#if SMP
+/** guards the timer wheel when there are several cores */
+static Spinlock timerlock;
+#endif
 
-/** the timer queue */
-static TimerQ timerQ;
+/** how late timeouts may expire */
+static Time slack;
 
-/** Number of ticks since beginning of run */
-static Time currentTime = 0;
+/** timer counters (guarded by timerlock) */
+static TimerStats stats;
 
 /** 
  *  Returns elapsed time since beginning of run.
  */
 Time Now()
 {
-    Time t, c, cc;
-    c = currentTime;
-    do {
-        t = read_timer(TIMER_ELAPSED);
-        cc = c;
-        c = currentTime;
-    } while (c != cc);
-    return (Tick - t) + c;
+    // just read the clock
+    return read_clock();
+}
+
+/**
+ *  Returns the first tick of given slot at given level, 
+ *  relative to the wheel's time.
+ */
+static inline Time slot_start(int level, int slot)
+{
+    int shift = level * WHEEL_BITS;
+    return ((wheel.ticks >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS))
+           | ((Time)slot << shift);
 }
 
 /**
- *  Inserts timeout in timeout queue in time order.
+ *  Inserts timeout in the timer wheel.
  */
-static void insertInQueue(Timeout *timeout)
+static void insertInWheel(Timeout *timeout)
 {
     // INTERRUPTS MUST BE DISABLED
 
-    // find timeout's place in the queue
-    Timeout *prev = NULL;
-    Timeout *curr = timerQ.head;
-    while (curr != NULL && timeout->time >= curr->time) {
-        prev = curr;
-        curr = curr->next;
-    }
-
-    // insert timeout into the queue
-    if (prev == NULL && curr == NULL) {
-        // only entry in queue
-        timerQ.head = timeout;
-        timeout->next = NULL;
-        Time now = Now();
-        Time diff = timeout->time - now;
-        set_timer_single(TIMER_TIMEOUT, diff);
-
-    } else if (prev == NULL && curr != NULL) {
-        // entry is first in queue but has a successor
-        timerQ.head = timeout;
-        timeout->next = curr;
-        Time now = Now();
-        Time diff = timeout->time - now;
-        set_timer_single(TIMER_TIMEOUT, diff);
-
-    } else if (prev != NULL && curr != NULL) {
-        // entry has a predecessor and a successor in the queue
-        prev->next = timeout;
-        timeout->next = curr;
-
-    } else /* prev != NULL && curr == NULL */ {
-        // entry is last but has a predecessor
-        prev->next = timeout;
-        timeout->next = NULL;
+    // find level and slot for timeout's tick
+    Time ticks = timeout->time >> WHEEL_RES;
+    if (ticks < wheel.ticks) {
+        ticks = wheel.ticks;
+    }
+    Time diff = ticks ^ wheel.ticks;
+    int level = 0;
+    if (diff >= WHEEL_SIZE) {
+        level = (63 - __builtin_clzll(diff)) / WHEEL_BITS;
+    }
+    int slot = (ticks >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+    // push timeout onto slot's list 
+    Timeout **head = &wheel.slot[level][slot];
+    timeout->next = *head;
+    if (*head != NULL) {
+        (*head)->link = &timeout->next;
     }
+    *head = timeout;
+    timeout->link = head;
+    wheel.occupied[level] |= (1ULL << slot);
 }
 
 /** 
- * Removes a designated entry from the timeout queue and returns it.
+ *  Removes timeout from the timer wheel.
  */
-static Timeout *removeFromQueue(Time time, Process *proc)
+static void removeFromWheel(Timeout *timeout)
 {
     // INTERRUPTS MUST BE DISABLED
-    // find entry in queue
-    Timeout *prev = NULL;
-    Timeout *curr = timerQ.head;            
-    while (curr != NULL && curr->time < time) {
-        prev = curr;
-        curr = curr->next;    
-    }
-    // curr == NULL || curr->time >= time
-    while (curr != NULL && curr->time == time && curr->proc != proc) {
-        prev = curr;
-        curr = curr->next;
-    }
-    // curr == NULL || curr->time > time || curr->proc == proc
-
-    // remove entry from queue
-    if (curr != NULL && curr->time == time && curr->proc == proc) 
-    {
-        if (prev != NULL)
-            prev->next = curr->next;
-        if (curr == timerQ.head) 
-            timerQ.head = curr->next;
-        // could restart timer if remove head entry..
-    } 
-
-    // return removed item (null if none)
-    return curr;
+
+    // unlink timeout from its slot's list
+    Timeout **link = timeout->link;
+    *link = timeout->next;
+    if (timeout->next != NULL) {
+        timeout->next->link = link;
+    }
+    timeout->link = NULL;
+
+    // if timeout was last in slot, show slot empty (it was first in
+    // the slot if its link is the slot's head rather than the next
+    // field of another timeout; compared as integers, since the link
+    // may point into another timeout)
+    uintptr_t offset = (uintptr_t)link - (uintptr_t)wheel.slot;
+    if (offset < sizeof(wheel.slot) && *link == NULL) {
+        uintptr_t i = offset / sizeof(Timeout *);
+        wheel.occupied[i / WHEEL_SIZE] &= ~(1ULL << (i % WHEEL_SIZE));
+    }
 }
 
 /** 
- *  Removes and returns the head item in the timeout queue.
- *  Called only when queue is nonempty.
+ *  Returns the time the timer wheel next needs attention (TIME_MAX 
+ *  if empty): the earliest expiration time in the first occupied 
+ *  slot at level 0, or the start of the first occupied slot at a 
+ *  higher level if that is earlier, when the slot is to be cascaded.
+ *  Only the one tick's timeouts are looked at, however many the wheel
+ *  holds.
+ */
+static Time earliest()
+{
+    // INTERRUPTS MUST BE DISABLED
+    Time earliest = TIME_MAX;
+    if (wheel.occupied[0] != 0) {
+        int slot = __builtin_ctzll(wheel.occupied[0]);
+        Timeout *t;
+        for (t = wheel.slot[0][slot]; t != NULL; t = t->next) {
+            if (t->time < earliest) {
+                earliest = t->time;
+            }
+        }
+    }
+    int level;
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+        if (wheel.occupied[level] != 0) {
+            int slot = __builtin_ctzll(wheel.occupied[level]);
+            Time start = slot_start(level, slot) << WHEEL_RES;
+            if (start < earliest) {
+                earliest = start;
+            }
+        }
+    }
+    return earliest;
+}
+
+/**
+ *  Returns the time to arm the timer for a timeout expiring at given
+ *  time: the first multiple of the slack no earlier than the time, so
+ *  that nearby timeouts share it and none is a whole slack late.
+ */
+static inline Time coalesce(Time time)
+{
+    if (slack == 0 || time > TIME_MAX - slack) {
+        return time;
+    }
+    return (time + slack - 1) / slack * slack;
+}
+
+/**
+ *  Sets timer to expire at given time.
  */
-static Timeout *removeHead()
+static void arm(Time time, Time now)
 {
     // INTERRUPTS MUST BE DISABLED
-    Timeout *timeout = timerQ.head;
-    timerQ.head = timerQ.head->next;
-    return timeout;
+    stats.arms++;
+    wheel.armed = time;
+    set_timer_single(TIMER_TIMEOUT, (time > now ? time - now : 1));
 }
 
+/**
+ *  Advances the wheel's time to given time, removing the timeouts
+ *  that are due and returning them as a list in expiry order 
+ *  (linked through their next fields).
+ */
+static Timeout *advance(Time now)
+{
+    // INTERRUPTS MUST BE DISABLED
+    Time target = now >> WHEEL_RES;
+    Timeout *due = NULL;
+    Timeout **tail = &due;
+    int ticks_due = 0;          // # of ticks with timeouts due
+    while (true) {
+
+        // find the next occupied slot the wheel's time reaches,
+        // preferring higher levels so cascades come first
+        int level, next_level = -1, next_slot = 0;
+        Time next = TIME_MAX;
+        for (level = 0; level < WHEEL_LEVELS; level++) {
+            if (wheel.occupied[level] != 0) {
+                int slot = __builtin_ctzll(wheel.occupied[level]);
+                Time start = slot_start(level, slot);
+                if (start <= next) {
+                    next = start;
+                    next_level = level;
+                    next_slot = slot;
+                }
+            }
+        }
+        if (next_level < 0 || next > target) {
+            break;
+        }
+        wheel.ticks = next;
+
+        if (next_level > 0) {
+            // cascade the slot's timeouts to lower levels
+            Timeout *list = wheel.slot[next_level][next_slot];
+            wheel.slot[next_level][next_slot] = NULL;
+            wheel.occupied[next_level] &= ~(1ULL << next_slot);
+            while (list != NULL) {
+                Timeout *timeout = list;
+                list = list->next;
+                insertInWheel(timeout);
+            }
+
+        } else {
+            // move due timeouts to the list
+            Timeout *timeout = wheel.slot[0][next_slot];
+            Timeout **first = tail;
+            while (timeout != NULL) {
+                Timeout *next_timeout = timeout->next;
+                if (timeout->time <= now) {
+                    removeFromWheel(timeout);
+                    timeout->next = NULL;
+                    *tail = timeout;
+                    tail = &timeout->next;
+                    stats.expired++;
+                }
+                timeout = next_timeout;
+            }
+            if (tail != first) {
+                ticks_due++;
+            }
+
+            // timeouts left in the slot are due later this tick
+            if (next == target) {
+                break;
+            }
+        }
+    }
+
+    // (a nested interrupt may already have advanced the wheel further)
+    if (target > wheel.ticks) {
+        wheel.ticks = target;
+    }
+    if (ticks_due > 1) {
+        stats.interrupts_avoided += ticks_due - 1;
+    }
+    return due;
+}
 
 /** Enables timeout guard for alternation,
  *  returning true if guard is ready */
 _Bool enable_timeout(Timeout *timeout)
 {
     // INTERRUPTS MUST BE DISABLED
-    _Bool ready = (Now() >= timeout->time);
+    Time now = Now();
+    _Bool ready = (now >= timeout->time);
     if (!ready) {
-        insertInQueue(timeout);
+        LOCK(&timerlock);
+        insertInWheel(timeout);
+
+        // if timeout must expire before the timer goes off, reset
+        // timer (unless slack lets it wait)
+        Time time = coalesce(timeout->time);
+        if (time < wheel.armed) {
+            arm(time, now);
+        } else if (timeout->time < wheel.armed) {
+            stats.arms_avoided++;
+        }
+        UNLOCK(&timerlock);
     }
     return ready;
 }
@@ -164,53 +313,88 @@ _Bool disable_timeout(Timeout *timeout)
 {  
     // INTERRUPTS MUST BE DISABLED
     _Bool ready = (Now() >= timeout->time);
-    removeFromQueue(timeout->time, timeout->proc);
+
+    // remove timeout if still in the wheel (once the handler has
+    // taken it out, only this process puts it back, so it need not
+    // lock the wheel to see that it is out)
+    if (LOAD(&timeout->link) != NULL) {
+        LOCK(&timerlock);
+        if (timeout->link != NULL) {
+            removeFromWheel(timeout);
+        }
+        UNLOCK(&timerlock);
+    }
     return ready;
 }
 
-static void handle_elapsed_time_interrupt()
+/** Advances periodic timeout, which has expired, to its next period
+ *  after the present time */
+void next_period(Timeout *timeout)
 {
-    // INTERRUPTS OF PRIORITY <= THAT OF ELAPSED TIME INTERRUPT ARE DISABLED
-    currentTime += Tick;      // increment tick count
+    // expiries stay on multiples of the period from the first, however
+    // late the process runs; periods that have also passed by now are
+    // skipped and counted as overruns
+    Time now = Now();
+    Time missed = 0;
+    if (now > timeout->time) {
+        missed = (now - timeout->time) / timeout->period;
+    }
+    timeout->overruns = missed;
+    timeout->time += (missed + 1) * timeout->period;
 }
 
 static void handle_timeout_interrupt()
 {
     // INTERRUPTS OF PRIORITY <= THAT OF TIMEOUT INTERRUPT ARE DISABLED
-    
-    // get current time
-    Time now = Now();
-
-    // ready processes whose timeouts are due
-    Timeout *head = timerQ.head; 
-    while (head != NULL && head->time <= now) {
 
-        // this one is due, so remove it from queue
-        removeHead(timerQ);
+    // timer is no longer set
+    LOCK(&timerlock);
+    wheel.armed = TIME_MAX;
+    stats.interrupts++;
 
-        // make process waiting on timeout ready if it isn't already
-        readyProcessIfNecessary(head->proc);
-
-        // resume at head of queue
-        head = timerQ.head;
+    // take the timeouts that are due (none if those the timer was
+    // set for were all disabled meanwhile: the timer is not reset
+    // when a timeout is removed, only when an earlier one is added)
+    Time now = Now();
+    Timeout *due = advance(now);
+    if (due == NULL) {
+        stats.spurious++;
     }
 
+    // ready their processes in one batch (the scheduler runs once, 
+    // after the handler, for all of them; the timeouts are not 
+    // theirs again till the lock is released)
+    readyTimeouts(due);
+
     // set time for next interrupt if any
-    if (timerQ.head != NULL) {
-        Time diff = timerQ.head->time - now;
-        set_timer_single(TIMER_TIMEOUT, diff);
+    Time next = earliest();
+    if (next != TIME_MAX) {
+        arm(coalesce(next), now);
     }
+    UNLOCK(&timerlock);
+}
+
+/** Sets how late timeouts may expire */
+void set_timer_slack(Time s)
+{
+    slack = s;
+}
+
+/** Returns timer counters */
+void get_timer_stats(TimerStats *s)
+{
+    DISABLE;
+    LOCK(&timerlock);
+    *s = stats;
+    UNLOCK(&timerlock);
+    ENABLE;
 }
 
 /** Initializes the timer module */
 void timer_init()
 {
-    // initialize elapsed time timer and define an interrupt handler for it
-    define_interrupt_handler(INTR_ELAPSED, handle_elapsed_time_interrupt);
-    init_timer(TIMER_ELAPSED, INTR_ELAPSED);
-
-    // start the elapsed time timer
-    set_timer_repeating(TIMER_ELAPSED, Tick);
+    // timer is not set
+    wheel.armed = TIME_MAX;
 
     // initialize timeout timer and define an interrupt handler for it
     define_interrupt_handler(INTR_TIMEOUT, handle_timeout_interrupt);
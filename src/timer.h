@@ -32,4 +32,23 @@ typedef uint64_t Time;
 /** Get elapsed time */
 Time Now();
 
+/** Sets how late timeouts may expire (0 for none, the default), so 
+ *  that the timer is armed for several at once; timeouts then expire 
+ *  together on multiples of the slack */
+void set_timer_slack(Time slack);
+
+/** Timer counters */
+typedef struct TimerStats {
+    uint64_t arms;              // # of times the timer was set
+    uint64_t arms_avoided;      // # of timeouts that needed no arm, for slack
+    uint64_t interrupts;        // # of timeout interrupts
+    uint64_t interrupts_avoided;// # of ticks with timeouts due that 
+                                //   shared an earlier tick's interrupt
+    uint64_t expired;           // # of timeouts expired by interrupts
+    uint64_t spurious;          // # of interrupts that found none due
+} TimerStats;
+
+/** Returns timer counters */
+void get_timer_stats(TimerStats *stats);
+
 #endif